@@ -0,0 +1,76 @@
+/*
+ * LD_PRELOAD shim which counts heap allocations of the compositor for
+ * dock-bench.py.
+ *
+ * The counters live in the file named by DOCK_BENCH_ALLOC_FILE, which is
+ * mapped shared so that the benchmark can read them while wayfire runs.
+ * glibc's __libc_* entry points are used directly, so no dlsym() (which
+ * allocates itself) is needed.
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+struct alloc_counters
+{
+    uint64_t allocations;
+    uint64_t bytes;
+};
+
+static struct alloc_counters fallback;
+static struct alloc_counters *counters = &fallback;
+
+__attribute__((constructor))
+static void map_counters(void)
+{
+    const char *path = getenv("DOCK_BENCH_ALLOC_FILE");
+    if (!path)
+    {
+        return;
+    }
+
+    int fd = open(path, O_RDWR | O_CREAT, 0600);
+    if ((fd < 0) || (ftruncate(fd, sizeof(struct alloc_counters)) < 0))
+    {
+        return;
+    }
+
+    void *mapping = mmap(NULL, sizeof(struct alloc_counters),
+        PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping != MAP_FAILED)
+    {
+        counters = mapping;
+    }
+}
+
+static void count(size_t size)
+{
+    __atomic_add_fetch(&counters->allocations, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&counters->bytes, size, __ATOMIC_RELAXED);
+}
+
+void *malloc(size_t size)
+{
+    count(size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+    count(n * size);
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    count(size);
+    return __libc_realloc(ptr, size);
+}
@@ -0,0 +1,370 @@
+#!/usr/bin/env python3
+"""
+Headless benchmark for the expo dock.
+
+For each workspace count, this starts wayfire on the headless backend with
+software GL, configures a 1xN workspace grid, and spawns terminal clients
+which redraw at a fixed rate on every workspace. It then opens the dock and
+drives these scripted phases over wayfire's IPC:
+
+- idle: the dock is open and the pointer stays still
+- hot-zone: the pointer crosses the dock edge back and forth
+- hover: the pointer moves up and down over the thumbnails
+- drag: a window is dragged between the thumbnails
+- switch: thumbnails are clicked to switch workspaces, reopening the dock
+  after each switch
+
+For every phase it reports the number of dock frames, the wall-clock time
+per frame and the CPU time spent per frame. The wall-clock time runs from
+the dock's pre-frame to its post-frame effect hook (frame_wall in
+expo/stats), reported as average and 99th percentile. The CPU time is split into the
+plugin's own timers (from expo/stats) and the whole compositor process
+(from /proc). It also reports heap allocations per frame, counted by
+alloc-counter.c, which is built with cc and preloaded into wayfire.
+
+Requirements: wayfire with the ipc, ipc-rules and stipc plugins, this
+plugin installed, a C compiler for the allocation counter (optional,
+--no-alloc-counter skips it), and a terminal for the clients (foot by
+default, see --client).
+
+Example:
+    ./dock-bench.py --workspaces 4 8 16 32 --json results.json
+"""
+
+import argparse
+import json
+import os
+import shutil
+import socket
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+OUTPUT_WIDTH = 1920
+OUTPUT_HEIGHT = 1080
+
+
+class WayfireIPC:
+    """Minimal client for wayfire's IPC socket: each message is a 4 byte
+    little-endian length followed by a JSON object."""
+
+    def __init__(self, path, timeout=10.0):
+        deadline = time.monotonic() + timeout
+        while True:
+            try:
+                self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+                self.sock.connect(path)
+                return
+            except OSError:
+                self.sock.close()
+                if time.monotonic() > deadline:
+                    raise
+                time.sleep(0.1)
+
+    def _read_exact(self, size):
+        data = b""
+        while len(data) < size:
+            chunk = self.sock.recv(size - len(data))
+            if not chunk:
+                raise ConnectionError("wayfire closed the IPC socket")
+            data += chunk
+        return data
+
+    def call(self, method, **data):
+        message = json.dumps({"method": method, "data": data}).encode()
+        self.sock.sendall(struct.pack("<I", len(message)) + message)
+        size = struct.unpack("<I", self._read_exact(4))[0]
+        response = json.loads(self._read_exact(size))
+        if "error" in response:
+            raise RuntimeError(f"{method}: {response['error']}")
+        return response
+
+
+def write_config(path, workspaces, args):
+    with open(path, "w") as config:
+        config.write(f"""
+[core]
+plugins = ipc ipc-rules stipc expo
+vwidth = 1
+vheight = {workspaces}
+
+[output:HEADLESS-1]
+mode = {OUTPUT_WIDTH}x{OUTPUT_HEIGHT}@60000
+
+[expo]
+thumbnail_refresh_rate = {args.thumbnail_refresh_rate}
+coalesce_motion = {str(args.coalesce_motion).lower()}
+""")
+
+
+def build_alloc_counter(workdir):
+    source = os.path.join(os.path.dirname(os.path.abspath(__file__)), "alloc-counter.c")
+    library = os.path.join(workdir, "alloc-counter.so")
+    compiler = os.environ.get("CC", "cc")
+    subprocess.run([compiler, "-shared", "-fPIC", "-O2", "-o", library, source], check=True)
+    return library
+
+
+def read_alloc_counter(path):
+    if not path or not os.path.exists(path):
+        return None
+    with open(path, "rb") as counters:
+        data = counters.read(16)
+    return struct.unpack("<QQ", data)[0] if len(data) == 16 else None
+
+
+def read_cpu_seconds(pid):
+    with open(f"/proc/{pid}/stat") as stat:
+        # The command name may contain spaces, the fields after it do not.
+        fields = stat.read().rsplit(")", 1)[1].split()
+    utime, stime = int(fields[11]), int(fields[12])
+    return (utime + stime) / os.sysconf("SC_CLK_TCK")
+
+
+class Bench:
+    def __init__(self, args, workspaces, workdir):
+        self.args = args
+        self.workspaces = workspaces
+        self.workdir = workdir
+        self.socket_path = os.path.join(workdir, f"wayfire-{workspaces}.socket")
+        self.alloc_file = None
+        self.proc = None
+        self.ipc = None
+
+    def start(self, alloc_library):
+        config = os.path.join(self.workdir, f"wayfire-{self.workspaces}.ini")
+        write_config(config, self.workspaces, self.args)
+
+        env = dict(os.environ)
+        env.update({
+            "WLR_BACKENDS": "headless",
+            "WLR_HEADLESS_OUTPUTS": "1",
+            "WLR_RENDERER": "gles2",
+            "WLR_RENDERER_ALLOW_SOFTWARE": "1",
+            "LIBGL_ALWAYS_SOFTWARE": "1",
+            "_WAYFIRE_SOCKET": self.socket_path,
+        })
+        if alloc_library:
+            self.alloc_file = os.path.join(self.workdir, f"allocs-{self.workspaces}.bin")
+            env["LD_PRELOAD"] = alloc_library
+            env["DOCK_BENCH_ALLOC_FILE"] = self.alloc_file
+
+        log = open(os.path.join(self.workdir, f"wayfire-{self.workspaces}.log"), "w")
+        self.proc = subprocess.Popen([self.args.wayfire, "-c", config],
+            env=env, stdout=log, stderr=subprocess.STDOUT)
+        self.ipc = WayfireIPC(self.socket_path)
+        self.ipc.call("stipc/ping")
+
+    def stop(self):
+        if self.proc:
+            self.proc.terminate()
+            try:
+                self.proc.wait(timeout=5)
+            except subprocess.TimeoutExpired:
+                self.proc.kill()
+
+    def spawn_clients(self):
+        period = 1.0 / self.args.damage_hz
+        command = self.args.client.format(period=period)
+        for _ in range(self.workspaces * self.args.clients_per_workspace):
+            self.ipc.call("stipc/run", cmd=command)
+
+        # Wait until the clients are mapped, then spread them over the grid.
+        expected = self.workspaces * self.args.clients_per_workspace
+        deadline = time.monotonic() + 20
+        views = []
+        while time.monotonic() < deadline:
+            views = [v for v in self.ipc.call("window-rules/list-views")
+                if v.get("type") == "toplevel" and v.get("mapped")]
+            if len(views) >= expected:
+                break
+            time.sleep(0.2)
+
+        layout = []
+        for index, view in enumerate(views):
+            ws = index % self.workspaces
+            # Cover the workspace centre, where the drag phase presses.
+            layout.append({"id": view["id"],
+                "x": (OUTPUT_WIDTH - 800) // 2 + 40 * (index // self.workspaces),
+                "y": ws * OUTPUT_HEIGHT + 100, "width": 800, "height": 600})
+        if layout:
+            self.ipc.call("stipc/layout_views", views=layout)
+        return len(views)
+
+    # Positions in the dock, see workspace_wall_t::wall_box_to_dock().
+    def dock_edge(self):
+        return OUTPUT_WIDTH - OUTPUT_WIDTH // self.workspaces
+
+    def thumbnail_center(self, ws):
+        slot = OUTPUT_HEIGHT / self.workspaces
+        return (OUTPUT_WIDTH - OUTPUT_WIDTH / self.workspaces / 2, slot * ws + slot / 2)
+
+    def move(self, x, y):
+        self.ipc.call("stipc/move_cursor", x=int(x), y=int(y))
+
+    def button(self, mode):
+        self.ipc.call("stipc/feed_button", mode=mode, combo="BTN_LEFT")
+
+    def run_for(self, seconds, step):
+        """Call step(i) at the motion rate for the given time."""
+        interval = 1.0 / self.args.motion_hz
+        end = time.monotonic() + seconds
+        i = 0
+        while time.monotonic() < end:
+            step(i)
+            i += 1
+            time.sleep(interval)
+
+    def phase_idle(self):
+        x, y = self.thumbnail_center(0)
+        self.move(x, y)
+        time.sleep(self.args.phase_seconds)
+
+    def phase_hot_zone(self):
+        edge = self.dock_edge()
+        self.run_for(self.args.phase_seconds,
+            lambda i: self.move(edge + (40 if i % 2 else -40), OUTPUT_HEIGHT / 2))
+
+    def phase_hover(self):
+        x = OUTPUT_WIDTH - OUTPUT_WIDTH / self.workspaces / 2
+        steps = 200
+        self.run_for(self.args.phase_seconds, lambda i: self.move(x,
+            OUTPUT_HEIGHT * abs((i % (2 * steps)) - steps) / steps * 0.99))
+
+    def phase_drag(self):
+        x, y = self.thumbnail_center(0)
+        _, target_y = self.thumbnail_center(self.workspaces - 1)
+        self.move(x, y)
+        self.button("press")
+        steps = 100
+
+        def step(i):
+            t = abs((i % (2 * steps)) - steps) / steps
+            self.move(x, target_y + (y - target_y) * t)
+        self.run_for(self.args.phase_seconds, step)
+        self.button("release")
+
+    def phase_switch(self):
+        # A click on a thumbnail selects its workspace and closes the dock,
+        # so it is opened again after the zoom animation.
+        end = time.monotonic() + self.args.phase_seconds
+        ws = 0
+        while time.monotonic() < end:
+            x, y = self.thumbnail_center(ws)
+            self.move(x, y)
+            self.button("full")
+            time.sleep(0.5)
+            self.ipc.call("expo/toggle")
+            time.sleep(0.5)
+            ws = (ws + 1) % self.workspaces
+
+    def measure(self, name, phase):
+        self.ipc.call("expo/stats-reset")
+        cpu_before = read_cpu_seconds(self.proc.pid)
+        allocs_before = read_alloc_counter(self.alloc_file)
+
+        phase()
+
+        cpu = read_cpu_seconds(self.proc.pid) - cpu_before
+        allocs_after = read_alloc_counter(self.alloc_file)
+        stats = self.ipc.call("expo/stats")
+        output = next(iter(stats["outputs"].values()), {})
+        frames = output.get("pre_frame", {}).get("count", 0)
+
+        def per_frame(total):
+            return total / frames if frames else None
+
+        frame_wall = output.get("frame_wall", {})
+        has_wall = frame_wall.get("count", 0) > 0
+
+        plugin_us = 0.0
+        for timer in [output.get("pre_frame", {}), output.get("schedule_instructions", {}),
+                      *output.get("render", {}).values()]:
+            plugin_us += timer.get("avg_us", 0) * timer.get("count", 0)
+
+        result = {
+            "phase": name,
+            "frames": frames,
+            "fps": frames / self.args.phase_seconds,
+            "wall_ms_per_frame": frame_wall["avg_us"] / 1000 if has_wall else None,
+            "wall_p99_ms": frame_wall["p99_us"] / 1000 if has_wall else None,
+            "plugin_cpu_us_per_frame": per_frame(plugin_us),
+            "process_cpu_us_per_frame": per_frame(cpu * 1e6),
+            "allocations_per_frame": per_frame(allocs_after - allocs_before)
+                if allocs_before is not None and allocs_after is not None else None,
+            "stats": stats,
+        }
+        return result
+
+    def run(self, alloc_library):
+        self.start(alloc_library)
+        try:
+            clients = self.spawn_clients()
+            self.ipc.call("expo/toggle")
+            time.sleep(1)
+
+            results = []
+            for name, phase in [("idle", self.phase_idle),
+                                ("hot-zone", self.phase_hot_zone),
+                                ("hover", self.phase_hover),
+                                ("drag", self.phase_drag),
+                                ("switch", self.phase_switch)]:
+                results.append(self.measure(name, phase))
+            return {"workspaces": self.workspaces, "clients": clients, "phases": results}
+        finally:
+            self.stop()
+
+
+def format_value(value, digits=1):
+    return "-" if value is None else f"{value:.{digits}f}"
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+        formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--workspaces", type=int, nargs="+", default=[4, 8, 16, 32])
+    parser.add_argument("--wayfire", default="wayfire")
+    parser.add_argument("--client", default="foot sh -c 'while :; do date +%s.%N; sleep {period}; done'",
+        help="command for a client, {period} is replaced by 1 / damage rate")
+    parser.add_argument("--clients-per-workspace", type=int, default=2)
+    parser.add_argument("--damage-hz", type=float, default=20)
+    parser.add_argument("--motion-hz", type=int, default=250)
+    parser.add_argument("--phase-seconds", type=float, default=5)
+    parser.add_argument("--thumbnail-refresh-rate", type=int, default=10)
+    parser.add_argument("--coalesce-motion", action="store_true")
+    parser.add_argument("--no-alloc-counter", action="store_true")
+    parser.add_argument("--json", help="write the full results to this file")
+    args = parser.parse_args()
+
+    if not shutil.which(args.wayfire):
+        sys.exit(f"{args.wayfire} not found")
+
+    workdir = tempfile.mkdtemp(prefix="dock-bench-")
+    alloc_library = None if args.no_alloc_counter else build_alloc_counter(workdir)
+
+    all_results = []
+    print(f"{'workspaces':>10} {'phase':>9} {'frames':>7} {'fps':>6} "
+          f"{'wall ms/f':>10} {'wall p99':>9} "
+          f"{'plugin us/f':>12} {'process us/f':>13} {'allocs/f':>9}")
+    for workspaces in args.workspaces:
+        result = Bench(args, workspaces, workdir).run(alloc_library)
+        all_results.append(result)
+        for phase in result["phases"]:
+            print(f"{workspaces:>10} {phase['phase']:>9} {phase['frames']:>7} "
+                  f"{phase['fps']:>6.1f} {format_value(phase['wall_ms_per_frame'], 2):>10} "
+                  f"{format_value(phase['wall_p99_ms'], 2):>9} "
+                  f"{format_value(phase['plugin_cpu_us_per_frame']):>12} "
+                  f"{format_value(phase['process_cpu_us_per_frame']):>13} "
+                  f"{format_value(phase['allocations_per_frame']):>9}")
+
+    if args.json:
+        with open(args.json, "w") as output:
+            json.dump(all_results, output, indent=2)
+
+    print(f"logs and configs are in {workdir}")
+
+
+if __name__ == "__main__":
+    main()
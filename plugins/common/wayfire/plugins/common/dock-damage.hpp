@@ -0,0 +1,154 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "wayfire/geometry.hpp"
+#include "wayfire/region.hpp"
+
+namespace wf
+{
+namespace dock_damage
+{
+/**
+ * Number of rectangles which went into and came out of simplify().
+ */
+struct counters_t
+{
+    uint64_t calls     = 0;
+    uint64_t rects_in  = 0;
+    uint64_t rects_out = 0;
+};
+
+namespace detail
+{
+inline int64_t area(const wf::geometry_t& box)
+{
+    return int64_t(box.width) * box.height;
+}
+
+inline wf::geometry_t bounding_box(const wf::geometry_t& a, const wf::geometry_t& b)
+{
+    int x1 = std::min(a.x, b.x);
+    int y1 = std::min(a.y, b.y);
+    int x2 = std::max(a.x + a.width, b.x + b.width);
+    int y2 = std::max(a.y + a.height, b.y + b.height);
+    return {x1, y1, x2 - x1, y2 - y1};
+}
+
+inline bool overlaps(const wf::geometry_t& a, const wf::geometry_t& b)
+{
+    return (a.x < b.x + b.width) && (b.x < a.x + a.width) &&
+           (a.y < b.y + b.height) && (b.y < a.y + a.height);
+}
+}
+
+/**
+ * Reduce a region to at most @max_rects rectangles which cover it.
+ *
+ * While there are too many rectangles, the pair whose bounding box adds the
+ * least area which is not part of the region is merged. A merged rectangle
+ * also absorbs the rectangles it now overlaps, so the result stays disjoint
+ * and every pixel is drawn at most once.
+ *
+ * Pixman splits regions into y-x bands, so fragmented damage (e.g. many
+ * small updates which were scaled down) easily has dozens of rectangles,
+ * each costing a scissor and a draw call. The result covers more pixels than
+ * the region, so it may only be used where the extra pixels are redrawn
+ * completely, e.g. as damage which is pushed to the scenegraph or as the
+ * damage of an offscreen render pass.
+ *
+ * @param max_rects The maximal number of rectangles, values <= 0 disable
+ *   the simplification.
+ * @param counters If set, the rectangle counts are added to it.
+ */
+inline std::vector<wf::geometry_t> simplify(const wf::region_t& region, int max_rects,
+    counters_t *counters = nullptr)
+{
+    // Bound the quadratic pair search for very fragmented regions.
+    static constexpr size_t MAX_EXACT_RECTS = 64;
+
+    std::vector<wf::geometry_t> boxes;
+    for (auto& rect : region)
+    {
+        boxes.push_back(wlr_box_from_pixman_box(rect));
+    }
+
+    const size_t rects_in = boxes.size();
+    if ((max_rects > 0) && (boxes.size() > (size_t)max_rects))
+    {
+        if (boxes.size() > MAX_EXACT_RECTS)
+        {
+            boxes = {region.get_extents()};
+        }
+
+        while (boxes.size() > (size_t)max_rects)
+        {
+            size_t best_a = 0, best_b = 1;
+            int64_t best_overhead = INT64_MAX;
+            for (size_t a = 0; a < boxes.size(); a++)
+            {
+                for (size_t b = a + 1; b < boxes.size(); b++)
+                {
+                    const int64_t overhead =
+                        detail::area(detail::bounding_box(boxes[a], boxes[b])) -
+                        detail::area(boxes[a]) - detail::area(boxes[b]);
+                    if (overhead < best_overhead)
+                    {
+                        best_overhead = overhead;
+                        best_a = a;
+                        best_b = b;
+                    }
+                }
+            }
+
+            auto merged = detail::bounding_box(boxes[best_a], boxes[best_b]);
+            boxes.erase(boxes.begin() + best_b);
+            boxes.erase(boxes.begin() + best_a);
+
+            bool absorbed = true;
+            while (absorbed)
+            {
+                absorbed = false;
+                for (size_t i = 0; i < boxes.size(); i++)
+                {
+                    if (detail::overlaps(merged, boxes[i]))
+                    {
+                        merged = detail::bounding_box(merged, boxes[i]);
+                        boxes.erase(boxes.begin() + i);
+                        absorbed = true;
+                        break;
+                    }
+                }
+            }
+
+            boxes.push_back(merged);
+        }
+    }
+
+    if (counters)
+    {
+        counters->calls++;
+        counters->rects_in  += rects_in;
+        counters->rects_out += boxes.size();
+    }
+
+    return boxes;
+}
+
+/**
+ * Like simplify(), but return the result as a region.
+ */
+inline wf::region_t simplify_region(const wf::region_t& region, int max_rects,
+    counters_t *counters = nullptr)
+{
+    wf::region_t result;
+    for (auto& box : simplify(region, max_rects, counters))
+    {
+        result |= box;
+    }
+
+    return result;
+}
+}
+}
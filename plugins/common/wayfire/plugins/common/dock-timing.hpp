@@ -0,0 +1,106 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+
+namespace wf
+{
+namespace dock_timing
+{
+/**
+ * Statistics about the duration of a repeatedly measured section of code.
+ *
+ * The minimum, maximum and average cover all samples since the last reset,
+ * the 99th percentile covers the last WINDOW samples. Adding a sample does
+ * not allocate.
+ *
+ * Note that render code only submits GL commands, so its timing is the CPU
+ * side cost and not the time the GPU spends on it.
+ */
+class timer_stats_t
+{
+  public:
+    static constexpr size_t WINDOW = 256;
+
+    struct summary_t
+    {
+        uint64_t count = 0;
+        uint32_t min_us = 0;
+        uint32_t max_us = 0;
+        double avg_us   = 0;
+        uint32_t p99_us = 0;
+    };
+
+    void add(std::chrono::steady_clock::duration duration)
+    {
+        const uint32_t us = std::chrono::duration_cast<
+            std::chrono::microseconds>(duration).count();
+
+        samples[count % WINDOW] = us;
+        count++;
+        total_us += us;
+        min_us    = std::min(min_us, us);
+        max_us    = std::max(max_us, us);
+    }
+
+    summary_t summarize() const
+    {
+        summary_t summary;
+        summary.count = count;
+        if (count == 0)
+        {
+            return summary;
+        }
+
+        summary.min_us = min_us;
+        summary.max_us = max_us;
+        summary.avg_us = 1.0 * total_us / count;
+
+        std::array<uint32_t, WINDOW> window = samples;
+        const size_t n   = std::min<uint64_t>(count, WINDOW);
+        const size_t p99 = std::min(n - 1, n * 99 / 100);
+        std::nth_element(window.begin(), window.begin() + p99, window.begin() + n);
+        summary.p99_us = window[p99];
+
+        return summary;
+    }
+
+    void reset()
+    {
+        *this = timer_stats_t{};
+    }
+
+  private:
+    std::array<uint32_t, WINDOW> samples{};
+    uint64_t count    = 0;
+    uint64_t total_us = 0;
+    uint32_t min_us   = std::numeric_limits<uint32_t>::max();
+    uint32_t max_us   = 0;
+};
+
+/**
+ * Adds the time between its construction and destruction to a timer_stats_t.
+ */
+class scoped_timer_t
+{
+  public:
+    scoped_timer_t(timer_stats_t& stats) : stats(stats)
+    {}
+
+    ~scoped_timer_t()
+    {
+        stats.add(std::chrono::steady_clock::now() - start);
+    }
+
+    scoped_timer_t(const scoped_timer_t&) = delete;
+    scoped_timer_t& operator =(const scoped_timer_t&) = delete;
+
+  private:
+    timer_stats_t& stats;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+};
+}
+}
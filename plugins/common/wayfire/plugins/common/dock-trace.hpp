@@ -0,0 +1,223 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "wayfire/util.hpp"
+
+/**
+ * Levels of dock trace messages.
+ *
+ * Messages with a level above DOCK_TRACE_MAX_LEVEL are removed at compile
+ * time, including the evaluation of their arguments. By default only
+ * messages which are not emitted per input event or per frame are compiled
+ * in, so that production builds do not pay for the hot paths.
+ */
+#define DOCK_TRACE_LEVEL_ERROR 1
+#define DOCK_TRACE_LEVEL_INFO  2
+#define DOCK_TRACE_LEVEL_DEBUG 3
+#define DOCK_TRACE_LEVEL_TRACE 4
+
+#ifndef DOCK_TRACE_MAX_LEVEL
+    #define DOCK_TRACE_MAX_LEVEL DOCK_TRACE_LEVEL_DEBUG
+#endif
+
+/**
+ * Record a printf-style message in the dock trace buffer.
+ *
+ * Example: DOCK_TRACE(TRACE, INPUT, "motion %d,%d", x, y);
+ *
+ * @param level One of ERROR, INFO, DEBUG and TRACE.
+ * @param category One of the categories in wf::dock_trace::category_t.
+ */
+#define DOCK_TRACE(level, category, ...) \
+    do { \
+        if constexpr (DOCK_TRACE_LEVEL_ ## level <= DOCK_TRACE_MAX_LEVEL) \
+        { \
+            auto& dock_trace_buffer = wf::dock_trace::get_buffer(); \
+            if (dock_trace_buffer.enabled(DOCK_TRACE_LEVEL_ ## level, \
+                wf::dock_trace::category)) \
+            { \
+                dock_trace_buffer.push(DOCK_TRACE_LEVEL_ ## level, \
+                    wf::dock_trace::category, __VA_ARGS__); \
+            } \
+        } \
+    } while (0)
+
+namespace wf
+{
+namespace dock_trace
+{
+enum category_t : uint32_t
+{
+    INPUT  = (1 << 0),
+    RENDER = (1 << 1),
+    DRAG   = (1 << 2),
+    ALL    = INPUT | RENDER | DRAG,
+};
+
+/**
+ * A fixed-size ring buffer of formatted trace messages.
+ *
+ * Writers never block and never allocate: each message claims a slot with an
+ * atomic increment and overwrites the oldest message. A slot's sequence
+ * number is odd while it is being written. dump() copies a slot and checks
+ * that its sequence number was even and unchanged before and after the copy
+ * (a seqlock), so messages torn by a concurrent writer are skipped.
+ */
+class buffer_t
+{
+  public:
+    static constexpr size_t CAPACITY     = 1024;
+    static constexpr size_t MESSAGE_SIZE = 128;
+
+    /**
+     * Check whether messages with the given level and category are recorded
+     * with the current runtime filter.
+     */
+    bool enabled(int level, uint32_t category) const
+    {
+        return (level <= max_level.load(std::memory_order_relaxed)) &&
+               (category & categories.load(std::memory_order_relaxed));
+    }
+
+    /**
+     * Set the runtime filter.
+     *
+     * @param level The highest level which is recorded. Levels above
+     *   DOCK_TRACE_MAX_LEVEL are never recorded.
+     * @param categories A bitmask of category_t.
+     */
+    void set_filter(int level, uint32_t categories)
+    {
+        this->max_level.store(level, std::memory_order_relaxed);
+        this->categories.store(categories, std::memory_order_relaxed);
+    }
+
+    __attribute__((format(printf, 4, 5)))
+    void push(int level, uint32_t category, const char *format, ...)
+    {
+        const uint64_t n = head.fetch_add(1, std::memory_order_relaxed);
+        auto& slot = slots[n % CAPACITY];
+
+        slot.sequence.store(2 * n + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.time_ms  = wf::get_current_time();
+        slot.level    = level;
+        slot.category = category;
+
+        va_list args;
+        va_start(args, format);
+        std::vsnprintf(slot.text.data(), MESSAGE_SIZE, format, args);
+        va_end(args);
+
+        slot.sequence.store(2 * n + 2, std::memory_order_release);
+    }
+
+    /**
+     * Get the recorded messages, oldest first.
+     */
+    std::vector<std::string> dump() const
+    {
+        std::vector<std::string> result;
+        const uint64_t end   = head.load(std::memory_order_acquire);
+        const uint64_t begin = end > CAPACITY ? end - CAPACITY : 0;
+
+        char line[MESSAGE_SIZE + 32];
+        for (uint64_t n = begin; n < end; n++)
+        {
+            const auto& slot = slots[n % CAPACITY];
+            if (slot.sequence.load(std::memory_order_acquire) != 2 * n + 2)
+            {
+                continue;
+            }
+
+            const uint32_t time_ms  = slot.time_ms;
+            const int level = slot.level;
+            const uint32_t category = slot.category;
+            char text[MESSAGE_SIZE];
+            std::memcpy(text, slot.text.data(), MESSAGE_SIZE);
+
+            // A writer may have claimed the slot during the copy.
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.sequence.load(std::memory_order_relaxed) != 2 * n + 2)
+            {
+                continue;
+            }
+
+            text[MESSAGE_SIZE - 1] = '\0';
+            std::snprintf(line, sizeof(line), "%u %s %s: %s", time_ms,
+                level_name(level), category_name(category), text);
+            result.push_back(line);
+        }
+
+        return result;
+    }
+
+    static const char *level_name(int level)
+    {
+        switch (level)
+        {
+          case DOCK_TRACE_LEVEL_ERROR:
+            return "E";
+
+          case DOCK_TRACE_LEVEL_INFO:
+            return "I";
+
+          case DOCK_TRACE_LEVEL_DEBUG:
+            return "D";
+
+          default:
+            return "T";
+        }
+    }
+
+    static const char *category_name(uint32_t category)
+    {
+        switch (category)
+        {
+          case INPUT:
+            return "input";
+
+          case RENDER:
+            return "render";
+
+          case DRAG:
+            return "drag";
+
+          default:
+            return "?";
+        }
+    }
+
+  private:
+    struct slot_t
+    {
+        std::atomic<uint64_t> sequence{0};
+        uint32_t time_ms  = 0;
+        int level = 0;
+        uint32_t category = 0;
+        std::array<char, MESSAGE_SIZE> text{};
+    };
+
+    std::array<slot_t, CAPACITY> slots;
+    std::atomic<uint64_t> head{0};
+    std::atomic<int> max_level{DOCK_TRACE_LEVEL_INFO};
+    std::atomic<uint32_t> categories{ALL};
+};
+
+/**
+ * Get the trace buffer shared by the dock and its helpers.
+ */
+inline buffer_t& get_buffer()
+{
+    static buffer_t buffer;
+    return buffer;
+}
+}
+}
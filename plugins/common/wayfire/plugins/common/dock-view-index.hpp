@@ -0,0 +1,347 @@
+#pragma once
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+#include "wayfire/core.hpp"
+#include "wayfire/geometry.hpp"
+#include "wayfire/output.hpp"
+#include "wayfire/signal-definitions.hpp"
+#include "wayfire/toplevel-view.hpp"
+#include "wayfire/workspace-set.hpp"
+
+namespace wf
+{
+/**
+ * A spatial index of the toplevel views of an output, used for hit-testing
+ * windows in the dock without traversing the scene graph.
+ *
+ * The bounding boxes of the views are bucketed by the workspaces they
+ * overlap, in coordinates relative to the first workspace (i.e (0,0)), so a
+ * lookup only checks the few views of a single workspace. Sticky views are
+ * checked on every workspace. When several views contain the point, the
+ * topmost one in the stacking order of the workspace set wins, the same
+ * order in which the scenegraph would find them.
+ *
+ * Geometry, map, unmap, sticky and workspace set changes update single
+ * views. Candidates are confirmed against their live input region, so
+ * transformer changes which shrink a view are handled too. Changes of
+ * the current workspace, the workspace grid or the output size invalidate the
+ * whole index, which is rebuilt on the next lookup.
+ */
+class dock_view_index_t
+{
+  public:
+    dock_view_index_t(wf::output_t *output) : output(output)
+    {}
+
+    /** Start tracking view changes. The index is rebuilt on the next lookup. */
+    void connect()
+    {
+        invalidate();
+        wf::get_core().connect(&on_view_mapped);
+        wf::get_core().connect(&on_view_unmapped);
+        wf::get_core().connect(&on_view_geometry_changed);
+        wf::get_core().connect(&on_view_moved_to_wset);
+        output->connect(&on_workspace_changed);
+        output->connect(&on_grid_changed);
+        output->connect(&on_output_config_changed);
+        output->connect(&on_view_sticky);
+    }
+
+    /** Stop tracking view changes and drop the index. */
+    void disconnect()
+    {
+        on_view_mapped.disconnect();
+        on_view_unmapped.disconnect();
+        on_view_geometry_changed.disconnect();
+        on_view_moved_to_wset.disconnect();
+        on_workspace_changed.disconnect();
+        on_grid_changed.disconnect();
+        on_output_config_changed.disconnect();
+        on_view_sticky.disconnect();
+        invalidate();
+    }
+
+    void invalidate()
+    {
+        valid = false;
+        buckets.clear();
+        sticky.clear();
+        entries.clear();
+    }
+
+    /**
+     * Find the topmost view at the given point.
+     *
+     * @param global The point, relative to the first workspace.
+     * @return The view, or nullptr if there is no view at the point.
+     */
+    wayfire_toplevel_view find_view_at(wf::point_t global)
+    {
+        if (!valid)
+        {
+            rebuild();
+        }
+
+        auto cell = workspace_at(global);
+        if (!grid_contains(cell))
+        {
+            return nullptr;
+        }
+
+        // The indexed boxes only preselect candidates, transformers may have
+        // changed them since. Each candidate is checked against its live
+        // input region in output-local coordinates, like
+        // wf::find_output_view_at() does, so shadows and client-side
+        // decoration margins do not count.
+        std::vector<wayfire_toplevel_view> hits;
+        wf::point_t output_local = {
+            global.x - current_ws.x * ws_size.width,
+            global.y - current_ws.y * ws_size.height,
+        };
+        for (auto& item : buckets[bucket_index(cell)])
+        {
+            if ((item.bbox & global) && accepts_input(item.view, output_local))
+            {
+                hits.push_back(item.view);
+            }
+        }
+
+        // Sticky views are shown at the same position on every workspace.
+        wf::point_t local = {
+            global.x - cell.x * ws_size.width,
+            global.y - cell.y * ws_size.height,
+        };
+        for (auto& item : sticky)
+        {
+            if ((item.bbox & local) && accepts_input(item.view, local))
+            {
+                hits.push_back(item.view);
+            }
+        }
+
+        if (hits.size() <= 1)
+        {
+            return hits.empty() ? nullptr : hits.front();
+        }
+
+        // Overlapping views are rare, resolve them with the real stacking
+        // order instead of keeping it up to date on every restack.
+        for (auto& view : output->wset()->get_views(wf::WSET_SORT_STACKING))
+        {
+            if (std::find(hits.begin(), hits.end(), view) != hits.end())
+            {
+                return view;
+            }
+        }
+
+        return nullptr;
+    }
+
+  private:
+    struct item_t
+    {
+        wayfire_toplevel_view view;
+        wf::geometry_t bbox;
+    };
+
+    // The range of workspaces a view is bucketed in, empty for sticky views.
+    struct entry_t
+    {
+        wf::point_t first_ws;
+        wf::point_t last_ws;
+    };
+
+    wf::output_t *output;
+    bool valid = false;
+    wf::dimensions_t grid_size = {0, 0};
+    wf::dimensions_t ws_size   = {1, 1};
+    wf::point_t current_ws     = {0, 0};
+
+    std::vector<std::vector<item_t>> buckets;
+    std::vector<item_t> sticky;
+    std::unordered_map<wf::toplevel_view_interface_t*, entry_t> entries;
+
+    void rebuild()
+    {
+        buckets.clear();
+        sticky.clear();
+        entries.clear();
+
+        grid_size  = output->wset()->get_workspace_grid_size();
+        current_ws = output->wset()->get_current_workspace();
+        auto og = output->get_relative_geometry();
+        ws_size = {std::max(og.width, 1), std::max(og.height, 1)};
+        buckets.resize(grid_size.width * grid_size.height);
+
+        valid = true;
+        for (auto& view : output->wset()->get_views())
+        {
+            insert(view);
+        }
+    }
+
+    bool should_index(wayfire_toplevel_view view) const
+    {
+        return view && view->is_mapped() && (view->get_wset() == output->wset());
+    }
+
+    static bool accepts_input(wayfire_toplevel_view view, wf::point_t local)
+    {
+        if (view->minimized)
+        {
+            return false;
+        }
+
+        wf::pointf_t point = {1.0 * local.x, 1.0 * local.y};
+        return view->get_transformed_node()->find_node_at(point).has_value();
+    }
+
+    wf::point_t workspace_at(wf::point_t global) const
+    {
+        // Round towards negative infinity for points left or above the grid.
+        auto div = [] (int a, int b) { return (a >= 0) ? a / b : (a - b + 1) / b; };
+        return {div(global.x, ws_size.width), div(global.y, ws_size.height)};
+    }
+
+    bool grid_contains(wf::point_t ws) const
+    {
+        return (ws.x >= 0) && (ws.y >= 0) &&
+               (ws.x < grid_size.width) && (ws.y < grid_size.height);
+    }
+
+    size_t bucket_index(wf::point_t ws) const
+    {
+        return ws.y * grid_size.width + ws.x;
+    }
+
+    void insert(wayfire_toplevel_view view)
+    {
+        if (!should_index(view))
+        {
+            return;
+        }
+
+        // Hit-test with what is actually drawn, including decorations and
+        // transformers.
+        auto bbox = view->get_transformed_node()->get_bounding_box();
+        if (view->sticky)
+        {
+            sticky.push_back({view, bbox});
+            entries[view.get()] = entry_t{{0, 0}, {-1, -1}};
+            return;
+        }
+
+        bbox.x += current_ws.x * ws_size.width;
+        bbox.y += current_ws.y * ws_size.height;
+
+        entry_t entry;
+        auto first = workspace_at(wf::origin(bbox));
+        auto last  = workspace_at({bbox.x + bbox.width - 1, bbox.y + bbox.height - 1});
+        entry.first_ws = {std::max(first.x, 0), std::max(first.y, 0)};
+        entry.last_ws  = {std::min(last.x, grid_size.width - 1),
+            std::min(last.y, grid_size.height - 1)};
+
+        for (int x = entry.first_ws.x; x <= entry.last_ws.x; x++)
+        {
+            for (int y = entry.first_ws.y; y <= entry.last_ws.y; y++)
+            {
+                buckets[bucket_index({x, y})].push_back({view, bbox});
+            }
+        }
+
+        entries[view.get()] = entry;
+    }
+
+    void remove(wayfire_toplevel_view view)
+    {
+        auto it = entries.find(view.get());
+        if (it == entries.end())
+        {
+            return;
+        }
+
+        sticky.erase(std::remove_if(sticky.begin(), sticky.end(),
+            [&] (const item_t& item) { return item.view == view; }), sticky.end());
+
+        const auto& entry = it->second;
+        for (int x = entry.first_ws.x; x <= entry.last_ws.x; x++)
+        {
+            for (int y = entry.first_ws.y; y <= entry.last_ws.y; y++)
+            {
+                auto& bucket = buckets[bucket_index({x, y})];
+                bucket.erase(std::remove_if(bucket.begin(), bucket.end(),
+                    [&] (const item_t& item) { return item.view == view; }), bucket.end());
+            }
+        }
+
+        entries.erase(it);
+    }
+
+    void update(wayfire_view view)
+    {
+        auto toplevel = wf::toplevel_cast(view);
+        if (!valid || !toplevel)
+        {
+            return;
+        }
+
+        remove(toplevel);
+        insert(toplevel);
+    }
+
+    wf::signal::connection_t<wf::view_mapped_signal> on_view_mapped = [=] (wf::view_mapped_signal *ev)
+    {
+        update(ev->view);
+    };
+
+    wf::signal::connection_t<wf::view_unmapped_signal> on_view_unmapped =
+        [=] (wf::view_unmapped_signal *ev)
+    {
+        if (auto toplevel = wf::toplevel_cast(ev->view))
+        {
+            remove(toplevel);
+        }
+    };
+
+    wf::signal::connection_t<wf::view_geometry_changed_signal> on_view_geometry_changed =
+        [=] (wf::view_geometry_changed_signal *ev)
+    {
+        update(ev->view);
+    };
+
+    wf::signal::connection_t<wf::view_moved_to_wset_signal> on_view_moved_to_wset =
+        [=] (wf::view_moved_to_wset_signal *ev)
+    {
+        if (valid && ev->view)
+        {
+            // Drops the view if it left this output's workspace set.
+            remove(ev->view);
+            insert(ev->view);
+        }
+    };
+
+    wf::signal::connection_t<wf::view_set_sticky_signal> on_view_sticky =
+        [=] (wf::view_set_sticky_signal *ev)
+    {
+        update(ev->view);
+    };
+
+    wf::signal::connection_t<wf::workspace_changed_signal> on_workspace_changed = [=] (auto)
+    {
+        invalidate();
+    };
+
+    wf::signal::connection_t<wf::workspace_grid_changed_signal> on_grid_changed = [=] (auto)
+    {
+        invalidate();
+    };
+
+    wf::signal::connection_t<wf::output_configuration_changed_signal> on_output_config_changed =
+        [=] (auto)
+    {
+        invalidate();
+    };
+};
+}
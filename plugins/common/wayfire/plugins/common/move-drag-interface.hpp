@@ -11,7 +11,10 @@
 #include "wayfire/scene.hpp"
 #include "wayfire/seat.hpp"
 #include "wayfire/signal-definitions.hpp"
+#include <chrono>
+#include <functional>
 #include <memory>
+#include <optional>
 #include <wayfire/nonstd/reverse.hpp>
 #include <wayfire/plugins/common/util.hpp>
 #include <wayfire/plugins/wobbly/wobbly-signal.hpp>
@@ -175,6 +178,13 @@ class scale_around_grab_t : public wf::scene::floating_inner_node_t
      */
     wf::point_t grab_position;
 
+    /**
+     * Render the view from a cached snapshot which is refreshed only when the
+     * view reports damage or the output scale changes, instead of rendering
+     * the view's subtree every frame.
+     */
+    bool use_proxy_texture = true;
+
     scale_around_grab_t() : floating_inner_node_t(false)
     {}
 
@@ -221,6 +231,8 @@ class scale_around_grab_t : public wf::scene::floating_inner_node_t
 
         void transform_damage_region(wf::region_t& region) override
         {
+            // Called for damage from the view itself, so its snapshot is stale.
+            proxy_dirty = true;
             region |= self->get_bounding_box();
         }
 
@@ -228,7 +240,15 @@ class scale_around_grab_t : public wf::scene::floating_inner_node_t
             const wf::region_t& region) override
         {
             auto bbox = self->get_bounding_box();
-            auto tex  = this->get_texture(target.scale);
+            if (!self->use_proxy_texture || proxy_dirty || !proxy_texture ||
+                (proxy_scale != target.scale))
+            {
+                proxy_texture = this->get_texture(target.scale);
+                proxy_scale   = target.scale;
+                proxy_dirty   = false;
+            }
+
+            auto& tex = *proxy_texture;
 
             OpenGL::render_begin(target);
             for (auto& rect : region)
@@ -239,6 +259,13 @@ class scale_around_grab_t : public wf::scene::floating_inner_node_t
 
             OpenGL::render_end();
         }
+
+      private:
+        // The last texture from get_texture(). It stays valid until the next
+        // call, which reallocates the buffer only if the size changes.
+        std::optional<wf::texture_t> proxy_texture;
+        float proxy_scale = 0;
+        bool proxy_dirty  = true;
     };
 
     void gen_render_instances(std::vector<scene::render_instance_uptr>& instances,
@@ -298,6 +325,9 @@ class dragged_view_node_t : public wf::scene::node_t
 {
     std::vector<dragged_view_t> views;
 
+    // The bounding box of all views, until one of them changes.
+    std::optional<wf::geometry_t> cached_bbox;
+
   public:
     dragged_view_node_t(std::vector<dragged_view_t> views) : node_t(false)
     {
@@ -317,6 +347,11 @@ class dragged_view_node_t : public wf::scene::node_t
 
     wf::geometry_t get_bounding_box() override
     {
+        if (cached_bbox)
+        {
+            return *cached_bbox;
+        }
+
         wf::region_t bounding;
         for (auto& view : views)
         {
@@ -326,7 +361,18 @@ class dragged_view_node_t : public wf::scene::node_t
             bounding |= bbox;
         }
 
-        return wlr_box_from_pixman_box(bounding.get_extents());
+        cached_bbox = wlr_box_from_pixman_box(bounding.get_extents());
+        return *cached_bbox;
+    }
+
+    /**
+     * Drop the cached bounding box, it is recomputed on the next
+     * get_bounding_box(). Needed whenever one of the dragged views' transformed
+     * nodes changes.
+     */
+    void invalidate_bounding_box()
+    {
+        cached_bbox.reset();
     }
 
     class dragged_view_render_instance_t : public wf::scene::render_instance_t
@@ -334,21 +380,44 @@ class dragged_view_node_t : public wf::scene::node_t
         wf::geometry_t last_bbox = {0, 0, 0, 0};
         wf::scene::damage_callback push_damage;
         std::vector<scene::render_instance_uptr> children;
-        wf::signal::connection_t<scene::node_damage_signal> on_node_damage =
-            [=] (scene::node_damage_signal *data)
-        {
-            push_damage(data->region);
-        };
+
+        // Damage which was already pushed since the last frame was scheduled.
+        // Child damage inside of it is dropped.
+        wf::region_t frame_damage;
+        bool bbox_pushed = false;
 
       public:
         dragged_view_render_instance_t(dragged_view_node_t *self, wf::scene::damage_callback push_damage,
             wf::output_t *shown_on)
         {
+            last_bbox = self->get_bounding_box();
             auto push_damage_child = [=] (wf::region_t child_damage)
             {
-                push_damage(last_bbox);
-                last_bbox = self->get_bounding_box();
-                push_damage(last_bbox);
+                // Any change of a child may change the bounding box.
+                self->invalidate_bounding_box();
+
+                // The first damage in a frame damages the old and the new
+                // bounding box, which covers most of what follows. With
+                // join_views and chatty clients, many damage events arrive per
+                // frame, so later ones only push what is not damaged yet.
+                // Everything is pushed right away, so damage raised while a
+                // frame is prepared still ends up in that frame.
+                if (!bbox_pushed)
+                {
+                    auto bbox = self->get_bounding_box();
+                    frame_damage  = last_bbox;
+                    frame_damage |= bbox;
+                    last_bbox     = bbox;
+                    bbox_pushed   = true;
+                    push_damage(frame_damage);
+                }
+
+                wf::region_t new_damage = child_damage ^ frame_damage;
+                if (!new_damage.empty())
+                {
+                    frame_damage |= new_damage;
+                    push_damage(new_damage);
+                }
             };
 
             for (auto& view : self->views)
@@ -361,6 +430,10 @@ class dragged_view_node_t : public wf::scene::node_t
         void schedule_instructions(std::vector<scene::render_instruction_t>& instructions,
             const wf::render_target_t& target, wf::region_t& damage) override
         {
+            // The damage so far is being repainted, start latching anew.
+            frame_damage.clear();
+            bbox_pushed = false;
+
             for (auto& inst : children)
             {
                 inst->schedule_instructions(instructions, target, damage);
@@ -408,6 +481,12 @@ struct drag_options_t
     bool join_views = false;
 
     double initial_scale = 1.0;
+
+    /**
+     * Render the dragged views from snapshots, see
+     * scale_around_grab_t::use_proxy_texture.
+     */
+    bool proxy_texture = true;
 };
 
 /**
@@ -428,6 +507,11 @@ class core_drag_t : public signal::provider_t
     }
 
   public:
+    core_drag_t()
+    {
+        wf::get_core().output_layout->connect(&on_output_layout_changed);
+    }
+
     /**
      * Start drag.
      *
@@ -483,6 +567,7 @@ class core_drag_t : public signal::provider_t
                 wf::view_bounding_box_up_to(v, "wobbly"), rel_grab_pos);
             tr->grab_position = grab_position;
             tr->scale_factor.animate(options.initial_scale, options.initial_scale);
+            tr->use_proxy_texture = options.proxy_texture;
             v->get_transformed_node()->add_transformer(
                 tr, wf::TRANSFORMER_HIGHLEVEL - 1);
 
@@ -500,6 +585,7 @@ class core_drag_t : public signal::provider_t
             }
 
             v->damage();
+            dragged.last_bbox = v->get_transformed_node()->get_bounding_box();
 
             // Make sure that wobbly has the correct geometry from the start!
             rebuild_wobbly(v, grab_position, dragged.transformer->relative_grab);
@@ -566,11 +652,30 @@ class core_drag_t : public signal::provider_t
         for (auto& v : all_views)
         {
             move_wobbly(v.view, to.x, to.y);
-            if (!view_held_in_place)
+        }
+
+        // All views follow the same grab position. Each view's transformed
+        // node gets a single damage of its old and new bounding box instead of
+        // the two of a begin/end_transform_update pair, and the overlay
+        // coalesces the damage of all views into one push per frame.
+        if (!view_held_in_place && !all_views.empty() &&
+            (all_views.front().transformer->grab_position != to))
+        {
+            for (auto& v : all_views)
             {
-                v.view->get_transformed_node()->begin_transform_update();
+                auto tnode = v.view->get_transformed_node();
+                wf::region_t damage = tnode->get_bounding_box();
                 v.transformer->grab_position = to;
-                v.view->get_transformed_node()->end_transform_update();
+                v.last_bbox = tnode->get_bounding_box();
+                damage |= v.last_bbox;
+
+                wf::scene::damage_node(tnode, damage);
+                wf::scene::update(tnode, wf::scene::update_flag::GEOMETRY);
+            }
+
+            if (render_node)
+            {
+                render_node->invalidate_bounding_box();
             }
         }
 
@@ -649,7 +754,12 @@ class core_drag_t : public signal::provider_t
     {
         for (auto& view : all_views)
         {
-            view.transformer->scale_factor.animate(new_scale);
+            // Restarting the animation towards the same scale would only
+            // produce more frames with damage.
+            if (view.transformer->scale_factor.end != new_scale)
+            {
+                view.transformer->scale_factor.animate(new_scale);
+            }
         }
     }
 
@@ -664,6 +774,12 @@ class core_drag_t : public signal::provider_t
     // Output where the action is happening.
     wf::output_t *current_output = NULL;
 
+    /**
+     * If set, called after each run of the pre-frame hook on the current
+     * output with the CPU time it took, e.g. for profiling.
+     */
+    std::function<void(std::chrono::steady_clock::duration)> pre_frame_profiler;
+
   private:
     // All views being dragged, more than one in case of join_views.
     std::vector<dragged_view_t> all_views;
@@ -679,10 +795,21 @@ class core_drag_t : public signal::provider_t
 
     std::shared_ptr<dragged_view_node_t> render_node;
 
+    // The layout geometry of current_output, empty if it is not known.
+    wf::geometry_t current_output_geometry = {0, 0, 0, 0};
+
     void update_current_output(wf::point_t grab)
     {
+        // The input stays on the same output for most of the drag, so check
+        // it first before searching the output layout.
+        if (current_output && (current_output_geometry & grab))
+        {
+            return;
+        }
+
         wf::pointf_t origin = {1.0 * grab.x, 1.0 * grab.y};
         auto output = wf::get_core().output_layout->get_output_coords_at(origin, origin);
+        current_output_geometry = output ? output->get_layout_geometry() : wf::geometry_t{0, 0, 0, 0};
 
         if (output != current_output)
         {
@@ -708,19 +835,48 @@ class core_drag_t : public signal::provider_t
 
     wf::effect_hook_t on_pre_frame = [=] ()
     {
+        const auto start = pre_frame_profiler ?
+            std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+        bool scaled = false;
         for (auto& v : this->all_views)
         {
             if (v.transformer->scale_factor.running())
             {
-                v.view->damage();
+                // Only the area covered by the view before or after this step
+                // of the animation changes.
+                auto bbox = v.view->get_transformed_node()->get_bounding_box();
+                wf::region_t damage = v.last_bbox;
+                damage |= bbox;
+                v.last_bbox = bbox;
+
+                wf::scene::damage_node(v.view->get_transformed_node(), damage);
+                scaled = true;
             }
         }
+
+        // The scale is not a transform update, so the overlay's bounding box
+        // has to be refreshed explicitly.
+        if (render_node && scaled)
+        {
+            render_node->invalidate_bounding_box();
+        }
+
+        if (pre_frame_profiler)
+        {
+            pre_frame_profiler(std::chrono::steady_clock::now() - start);
+        }
     };
 
     wf::signal::connection_t<view_unmapped_signal> on_view_unmap = [=] (auto *ev)
     {
         handle_input_released();
     };
+
+    wf::signal::connection_t<wf::output_layout_configuration_changed_signal> on_output_layout_changed =
+        [=] (auto)
+    {
+        current_output_geometry = {0, 0, 0, 0};
+    };
 };
 
 /**
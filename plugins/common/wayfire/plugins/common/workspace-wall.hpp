@@ -1,10 +1,13 @@
 #pragma once
 
 
+#include <algorithm>
 #include <any>
+#include <cmath>
 #include <cstdlib>
 #include <glm/gtc/matrix_transform.hpp>
 #include <memory>
+#include <optional>
 #include "wayfire/core.hpp"
 #include "wayfire/debug.hpp"
 #include "wayfire/geometry.hpp"
@@ -17,8 +20,12 @@
 #include "wayfire/scene.hpp"
 #include "wayfire/signal-definitions.hpp"
 #include "wayfire/signal-provider.hpp"
+#include "wayfire/util.hpp"
+#include "wayfire/util/duration.hpp"
 #include "wayfire/workspace-stream.hpp"
 #include "wayfire/workspace-set.hpp"
+#include "wayfire/plugins/common/dock-damage.hpp"
+#include "wayfire/plugins/common/dock-timing.hpp"
 
 namespace wf
 {
@@ -84,6 +91,84 @@ struct wall_frame_event_t
     {}
 };
 
+/**
+ * Per-workspace state of a workspace wall.
+ *
+ * Each field is a contiguous array indexed by index(), so that per-frame
+ * passes over all workspaces do not need lookups or allocations.
+ */
+class workspace_state_table_t
+{
+  public:
+    /* The brightness of each workspace, 1.0 means not dimmed. */
+    std::vector<float> dim;
+
+    /* Animations for fading the brightness of each workspace. */
+    std::vector<wf::animation::simple_animation_t> fade;
+
+    /* Set when the dim value changed and the workspace has not been redrawn
+     * since. */
+    std::vector<uint8_t> dirty;
+
+    /* CPU time spent on rendering the thumbnail of each workspace. */
+    std::vector<dock_timing::timer_stats_t> thumbnail_time;
+
+    /**
+     * Resize the table for a new workspace grid. The dim values of workspaces
+     * which are part of both grids are kept, fades start from scratch.
+     *
+     * @param fade_length The option with the duration of the fade animations.
+     */
+    template<class Length>
+    void resize(wf::dimensions_t new_grid, const Length& fade_length)
+    {
+        std::vector<float> new_dim(new_grid.width * new_grid.height, 1.0);
+        for (int x = 0; x < std::min(grid.width, new_grid.width); x++)
+        {
+            for (int y = 0; y < std::min(grid.height, new_grid.height); y++)
+            {
+                new_dim[y * new_grid.width + x] = dim[index({x, y})];
+            }
+        }
+
+        grid = new_grid;
+        dim.swap(new_dim);
+        dirty.assign(dim.size(), 0);
+        thumbnail_time.assign(dim.size(), {});
+
+        fade.clear();
+        fade.reserve(dim.size());
+        for (size_t i = 0; i < dim.size(); i++)
+        {
+            fade.emplace_back(fade_length);
+        }
+    }
+
+    bool contains(wf::point_t ws) const
+    {
+        return (ws.x >= 0) && (ws.y >= 0) &&
+               (ws.x < grid.width) && (ws.y < grid.height);
+    }
+
+    int index(wf::point_t ws) const
+    {
+        return ws.y * grid.width + ws.x;
+    }
+
+    wf::point_t workspace(int index) const
+    {
+        return {index % grid.width, index / grid.width};
+    }
+
+    int size() const
+    {
+        return dim.size();
+    }
+
+  private:
+    wf::dimensions_t grid = {0, 0};
+};
+
 /**
  * A helper class to render workspaces arranged in a grid.
  */
@@ -101,6 +186,7 @@ class workspace_wall_t : public wf::signal::provider_t
     ~workspace_wall_t()
     {
         stop_output_renderer(false);
+        destroy_render_node();
     }
 
     /**
@@ -121,7 +207,73 @@ class workspace_wall_t : public wf::signal::provider_t
      */
     void set_gap_size(int size)
     {
+        if (size == this->gap_size)
+        {
+            return;
+        }
+
+        wf::region_t damage = get_dock_rectangle();
         this->gap_size = size;
+        if (is_rendering())
+        {
+            damage |= get_dock_rectangle();
+            scene::damage_node(this->render_node, damage);
+        }
+    }
+
+    /**
+     * Set the workspaces which are shown live, that is, updated at the refresh
+     * rate of the output. Changes on all other workspaces are picked up at the
+     * rate set with set_background_refresh_rate().
+     */
+    void set_live_workspaces(const std::vector<wf::point_t>& workspaces)
+    {
+        this->live_workspaces = workspaces;
+    }
+
+    /**
+     * Limit how often workspaces which are not live are updated.
+     *
+     * @param hz The maximal refresh rate, or 0 to update all workspaces at the
+     *   refresh rate of the output.
+     */
+    void set_background_refresh_rate(int hz)
+    {
+        this->background_refresh_rate = hz;
+    }
+
+    /**
+     * Set how long the render instances and thumbnail of a workspace which
+     * left the viewport are kept. A workspace which comes back in time does
+     * not have to be rendered from scratch.
+     *
+     * @param ms The delay in milliseconds, 0 to release them immediately.
+     */
+    void set_idle_release_timeout(int ms)
+    {
+        this->idle_release_timeout = ms;
+    }
+
+    /**
+     * Set the maximal number of rectangles of the damage which workspaces push
+     * to the dock and of the damage of a thumbnail update. More fragmented
+     * damage is merged into fewer, larger rectangles, see
+     * dock_damage::simplify().
+     *
+     * @param max_rects The maximal number of rectangles, 0 to keep the damage
+     *   as it is.
+     */
+    void set_max_damage_rects(int max_rects)
+    {
+        this->max_damage_rects = max_rects;
+    }
+
+    /**
+     * Get the number of damage rectangles before and after simplification.
+     */
+    dock_damage::counters_t& get_damage_counters()
+    {
+        return damage_counters;
     }
 
     /**
@@ -137,11 +289,17 @@ class workspace_wall_t : public wf::signal::provider_t
      */
     void set_viewport(const wf::geometry_t& viewport_geometry)
     {
+        if (viewport_geometry == this->viewport)
+        {
+            return;
+        }
+
+        wf::region_t damage = get_dock_rectangle();
         this->viewport = viewport_geometry;
-        if (render_node)
+        if (is_rendering())
         {
-            scene::damage_node(this->render_node,
-                this->render_node->get_bounding_box());
+            damage |= get_dock_rectangle();
+            scene::damage_node(this->render_node, damage);
         }
     }
 
@@ -164,9 +322,46 @@ class workspace_wall_t : public wf::signal::provider_t
      */
     void start_output_renderer()
     {
-        wf::dassert(render_node == nullptr, "Starting workspace-wall twice?");
-        render_node = std::make_shared<workspace_wall_node_t>(this);
-        scene::add_front(wf::get_core().scene(), render_node);
+        wf::dassert(!is_rendering(), "Starting workspace-wall twice?");
+        if (render_node &&
+            (render_node->get_grid_size() != output->wset()->get_workspace_grid_size()))
+        {
+            destroy_render_node();
+        }
+
+        if (render_node)
+        {
+            scene::set_node_enabled(render_node, true);
+            scene::damage_node(render_node, get_dock_rectangle());
+        } else
+        {
+            render_node = std::make_shared<workspace_wall_node_t>(this);
+            scene::add_front(wf::get_core().scene(), render_node);
+        }
+    }
+
+    /**
+     * Keep the scenegraph node of the wall when the renderer is stopped and
+     * only disable it. Starting the renderer again then reuses the workspace
+     * streams and the thumbnail buffers instead of allocating them anew.
+     *
+     * The node is recreated if the workspace grid changed in the meantime.
+     */
+    void set_persistent(bool persistent)
+    {
+        this->persistent = persistent;
+        if (!persistent && !is_rendering())
+        {
+            destroy_render_node();
+        }
+    }
+
+    /**
+     * Check whether the wall is currently rendered.
+     */
+    bool is_rendering() const
+    {
+        return render_node && render_node->is_enabled();
     }
 
     /**
@@ -177,13 +372,20 @@ class workspace_wall_t : public wf::signal::provider_t
      */
     void stop_output_renderer(bool reset_viewport)
     {
-        if (!render_node)
+        if (!is_rendering())
         {
             return;
         }
 
-        scene::remove_child(render_node);
-        render_node = nullptr;
+        if (persistent)
+        {
+            scene::set_node_enabled(render_node, false);
+        } else
+        {
+            destroy_render_node();
+        }
+
+        std::fill(ws_state.dirty.begin(), ws_state.dirty.end(), 0);
 
         if (reset_viewport)
         {
@@ -202,7 +404,7 @@ class workspace_wall_t : public wf::signal::provider_t
         auto size = this->output->get_screen_size();
 
         return {
-            ws.x * (size.width + gap_size+120000),
+            ws.x * (size.width + gap_size),
             ws.y * (size.height + gap_size),
             size.width,
             size.height
@@ -225,16 +427,110 @@ class workspace_wall_t : public wf::signal::provider_t
         };
     }
 
+    /**
+     * Map a box from workspace wall coordinates to the place where it is shown
+     * on an output with geometry @output_box.
+     *
+     * The viewport is scaled onto the output like in the regular expo, and the
+     * result is then shifted right by half an output, so that the column of
+     * workspaces ends up as a dock strip along the right edge.
+     */
+    wf::geometry_t wall_box_to_dock(wf::geometry_t box,
+        wf::geometry_t output_box) const
+    {
+        if ((viewport.width <= 0) || (viewport.height <= 0))
+        {
+            return {0, 0, 0, 0};
+        }
+
+        const int half_width = output->get_screen_size().width / 2;
+        box.x -= half_width;
+        box    = scale_box(viewport, output_box, box);
+        box.x += half_width;
+        return box;
+    }
+
+    /**
+     * The inverse of wall_box_to_dock().
+     */
+    wf::geometry_t dock_box_to_wall(wf::geometry_t box,
+        wf::geometry_t output_box) const
+    {
+        if ((output_box.width <= 0) || (output_box.height <= 0))
+        {
+            return {0, 0, 0, 0};
+        }
+
+        const int half_width = output->get_screen_size().width / 2;
+        box.x -= half_width;
+        box    = scale_box(output_box, viewport, box);
+        box.x += half_width;
+        return box;
+    }
+
+    /**
+     * Get the part of the output covered by the dock strip with the current
+     * viewport, in output-layout coordinates.
+     */
+    wf::geometry_t get_dock_rectangle() const
+    {
+        return wall_box_to_dock(get_wall_rectangle(),
+            output->get_layout_geometry());
+    }
+
     /**
      * Get/set the dimming factor for a given workspace.
      */
     void set_ws_dim(const wf::point_t& ws, float value)
     {
-        render_colors[{ws.x, ws.y}] = value;
-        if (render_node)
+        if (!ws_state.contains(ws))
+        {
+            return;
+        }
+
+        const int idx = ws_state.index(ws);
+        if (ws_state.dim[idx] == value)
         {
-            scene::damage_node(render_node, render_node->get_bounding_box());
+            return;
         }
+
+        ws_state.dim[idx] = value;
+        if (is_rendering() && !ws_state.dirty[idx])
+        {
+            ws_state.dirty[idx] = 1;
+
+            // Rounding in scale_box() may lose the partially covered pixels
+            // at the edges of the slot.
+            auto box = wall_box_to_dock(get_workspace_rectangle(ws),
+                output->get_layout_geometry());
+            scene::damage_node(render_node, wf::geometry_t{box.x - 1, box.y - 1,
+                box.width + 2, box.height + 2});
+        }
+    }
+
+    /**
+     * Get the per-workspace state of the wall. It has to be resized by the
+     * user of the wall whenever the workspace grid changes.
+     */
+    workspace_state_table_t& get_workspace_state()
+    {
+        return ws_state;
+    }
+
+    /**
+     * CPU time spent in the wall's render instance.
+     */
+    struct timing_t
+    {
+        dock_timing::timer_stats_t schedule_instructions;
+        dock_timing::timer_stats_t background;
+        dock_timing::timer_stats_t frame_event;
+        dock_timing::timer_stats_t thumbnail;
+    };
+
+    timing_t& get_timing()
+    {
+        return timing;
     }
 
   protected:
@@ -244,34 +540,92 @@ class workspace_wall_t : public wf::signal::provider_t
     int gap_size = 0;
     wf::geometry_t viewport = {0, 0, 0, 0};
 
-    std::map<std::pair<int, int>, float> render_colors;
+    workspace_state_table_t ws_state;
+    timing_t timing;
+
+    std::vector<wf::point_t> live_workspaces;
+    int background_refresh_rate = 0;
+    int idle_release_timeout    = 0;
+    int max_damage_rects = 0;
+    dock_damage::counters_t damage_counters;
+
+    wf::region_t simplify_damage(const wf::region_t& damage)
+    {
+        return dock_damage::simplify_region(damage, max_damage_rects, &damage_counters);
+    }
+
+    bool is_live_workspace(wf::point_t ws) const
+    {
+        return (background_refresh_rate <= 0) ||
+               (std::find(live_workspaces.begin(), live_workspaces.end(), ws) !=
+                live_workspaces.end());
+    }
 
     float get_color_for_workspace(wf::point_t ws)
     {
-        auto it = render_colors.find({ws.x, ws.y});
-        if (it == render_colors.end())
+        if (!ws_state.contains(ws))
         {
             return 1.0;
         }
 
-        return it->second;
+        const int idx = ws_state.index(ws);
+        ws_state.dirty[idx] = 0;
+        return ws_state.dim[idx];
     }
 
     /**
-     * Get a list of workspaces visible in the viewport.
+     * Get the range of workspaces which are at least partially shown on the
+     * output with the current viewport.
+     *
+     * @return A rectangle in workspace coordinates, i.e workspace (i, j) is
+     *   visible if the rectangle contains the point (i, j).
      */
-    std::vector<wf::point_t> get_visible_workspaces(wf::geometry_t viewport) const
+    wf::geometry_t get_visible_workspace_range() const
     {
-        std::vector<wf::point_t> visible;
+        auto og    = output->get_layout_geometry();
+        auto shown = dock_box_to_wall(og, og);
+        if ((shown.width <= 0) || (shown.height <= 0))
+        {
+            return {0, 0, 0, 0};
+        }
+
+        auto size  = output->get_screen_size();
         auto wsize = output->wset()->get_workspace_grid_size();
-        for (int i = 0; i < wsize.width; i++)
+
+        // Workspace i spans [i * step, i * step + size) on each axis.
+        auto visible_span = [] (int from, int to, int step, int size, int count)
         {
-            for (int j = 0; j < wsize.height; j++)
+            int first = std::floor(1.0 * (from - size) / step) + 1;
+            int last  = std::ceil(1.0 * to / step) - 1;
+            first = std::max(first, 0);
+            last  = std::min(last, count - 1);
+            return std::pair<int, int>{first, std::max(last - first + 1, 0)};
+        };
+
+        auto [x, w] = visible_span(shown.x, shown.x + shown.width,
+            size.width + gap_size, size.width, wsize.width);
+        auto [y, h] = visible_span(shown.y, shown.y + shown.height,
+            size.height + gap_size, size.height, wsize.height);
+        if ((w == 0) || (h == 0))
+        {
+            return {0, 0, 0, 0};
+        }
+
+        return {x, y, w, h};
+    }
+
+    /**
+     * Get a list of workspaces visible on the output.
+     */
+    std::vector<wf::point_t> get_visible_workspaces() const
+    {
+        std::vector<wf::point_t> visible;
+        auto range = get_visible_workspace_range();
+        for (int i = range.x; i < range.x + range.width; i++)
+        {
+            for (int j = range.y; j < range.y + range.height; j++)
             {
-                if (viewport & get_workspace_rectangle({i, j}))
-                {
-                    visible.push_back({i, j});
-                }
+                visible.push_back({i, j});
             }
         }
 
@@ -288,6 +642,122 @@ class workspace_wall_t : public wf::signal::provider_t
             std::vector<std::vector<std::vector<scene::render_instance_uptr>>>
             instances;
 
+            /**
+             * The state of the offscreen copy of a workspace at the size of its
+             * slot in the dock, see workspace_wall_node_t::thumbnail_buffers.
+             * The dock is composed from these, so a workspace is rendered again
+             * only when its contents change.
+             */
+            struct thumbnail_t
+            {
+                /* Damage accumulated since the last update, in workspace-local
+                 * coordinates. */
+                wf::region_t damage;
+
+                /* Damage of the dock slot held back by the refresh policy. */
+                wf::region_t pending_damage;
+
+                /* Whether the workspace is in the viewport. */
+                bool visible = false;
+
+                /* Whether the render instances of the workspace exist. They are
+                 * created lazily and released some time after the workspace
+                 * leaves the viewport. */
+                bool has_instances = false;
+
+                /* When the workspace left the viewport, see get_current_time(). */
+                uint32_t hidden_since = 0;
+            };
+
+            /* Workspaces in the viewport, see update_visible_workspaces() */
+            wf::geometry_t visible_range = {0, 0, 0, 0};
+
+            /* The dock slot of a visible workspace and its damage in the
+             * current frame, see bucket_damage(). */
+            struct slot_t
+            {
+                wf::geometry_t box;
+                wf::region_t damage;
+            };
+
+            /* One slot per workspace in visible_range, column by column. */
+            std::vector<slot_t> slots;
+
+            size_t slot_index(wf::point_t ws) const
+            {
+                return (ws.x - visible_range.x) * visible_range.height + (ws.y - visible_range.y);
+            }
+
+            /* Creating the render instances of a workspace means creating those
+             * of all views on it, so only a few workspaces are set up per frame. */
+            static constexpr int MAX_NEW_WORKSPACES_PER_FRAME = 2;
+
+            /* Damages the slots of workspaces created in the last frame, and
+             * keeps frames coming until all visible workspaces are set up. */
+            wf::wl_idle_call idle_push_new_workspaces;
+            wf::region_t new_workspaces_damage;
+
+            /* Releases workspaces which stayed outside the viewport for too long. */
+            wf::wl_timer<true> release_timer;
+
+            std::vector<std::vector<thumbnail_t>> thumbnails;
+
+            /* Pushes the held back damage of non-live workspaces. */
+            wf::wl_timer<true> refresh_timer;
+
+            /**
+             * Push damage of a workspace's dock slot. Damage of workspaces which
+             * are not live is collected and pushed by refresh_timer, so that
+             * they are updated at most with the wall's background refresh rate.
+             */
+            void push_workspace_damage(wf::point_t ws, const wf::region_t& damage)
+            {
+                if (self->wall->is_live_workspace(ws))
+                {
+                    push_damage(self->wall->simplify_damage(damage));
+                    return;
+                }
+
+                thumbnails[ws.x][ws.y].pending_damage |= damage;
+                if (!refresh_timer.is_connected())
+                {
+                    const int rate = self->wall->background_refresh_rate;
+                    refresh_timer.set_timeout(std::max(1, 1000 / rate), [=] ()
+                    {
+                        return flush_pending_damage();
+                    });
+                }
+            }
+
+            /**
+             * Push all held back damage.
+             *
+             * @return Whether the refresh timer should keep running.
+             */
+            bool flush_pending_damage()
+            {
+                wf::region_t damage;
+                for (auto& column : thumbnails)
+                {
+                    for (auto& thumb : column)
+                    {
+                        if (!thumb.pending_damage.empty())
+                        {
+                            damage |= self->wall->simplify_damage(thumb.pending_damage);
+                            thumb.pending_damage.clear();
+                        }
+                    }
+                }
+
+                if (damage.empty())
+                {
+                    return false;
+                }
+
+                push_damage(damage);
+                return true;
+            }
+
             scene::damage_callback push_damage;
             wf::signal::connection_t<scene::node_damage_signal> on_wall_damage =
                 [=] (scene::node_damage_signal *ev)
@@ -315,141 +785,403 @@ class workspace_wall_t : public wf::signal::provider_t
                 self->connect(&on_wall_damage);
 
                 instances.resize(self->workspaces.size());
+                thumbnails.resize(self->workspaces.size());
                 for (int i = 0; i < (int)self->workspaces.size(); i++)
                 {
                     instances[i].resize(self->workspaces[i].size());
-                    for (int j = 0; j < (int)self->workspaces[i].size(); j++)
+                    thumbnails[i].resize(self->workspaces[i].size());
+                }
+
+            }
+
+            /**
+             * Generate the render instances of a workspace. The workspace did not
+             * report damage without them, so its thumbnail is rendered from
+             * scratch.
+             */
+            void gen_workspace_instances(int i, int j)
+            {
+                auto push_damage_child = [=] (const wf::region_t& damage)
+                {
+                    thumbnails[i][j].damage |= damage;
+                    if (!thumbnails[i][j].visible)
+                    {
+                        return;
+                    }
+
+                    wf::region_t our_damage;
+                    for (auto& rect : damage)
+                    {
+                        wf::geometry_t box = wlr_box_from_pixman_box(rect);
+                        box = box + wf::origin(get_workspace_rect({i, j}));
+                        box = self->wall->wall_box_to_dock(box,
+                            self->get_bounding_box());
+
+                        // Rounding in scale_box() may lose the partially
+                        // covered pixels at the edges.
+                        our_damage |= wf::geometry_t{box.x - 1, box.y - 1,
+                            box.width + 2, box.height + 2};
+                    }
+
+                    push_workspace_damage({i, j}, our_damage);
+                };
+
+                auto& thumb = thumbnails[i][j];
+                self->workspaces[i][j]->gen_render_instances(instances[i][j],
+                    push_damage_child, self->wall->output);
+                thumb.damage |= self->workspaces[i][j]->get_bounding_box();
+                thumb.has_instances = true;
+            }
+
+            /**
+             * Drop the render instances and thumbnail of a workspace which is no
+             * longer visible.
+             */
+            void release_workspace_instances(int i, int j)
+            {
+                auto& thumb = thumbnails[i][j];
+                instances[i][j].clear();
+                thumb.damage.clear();
+                thumb.pending_damage.clear();
+                thumb.has_instances = false;
+
+                OpenGL::render_begin();
+                self->thumbnail_buffers[i][j].release();
+                OpenGL::render_end();
+            }
+
+            /**
+             * Track which workspaces are in the viewport and create the render
+             * instances of those which do not have them yet. Culled workspaces
+             * produce no instructions and no damage.
+             */
+            void update_visible_workspaces()
+            {
+                auto range = wf::geometry_intersection(
+                    self->wall->get_visible_workspace_range(),
+                    {0, 0, (int)instances.size(),
+                        instances.empty() ? 0 : (int)instances[0].size()});
+                if (range != visible_range)
+                {
+                    const uint32_t now = wf::get_current_time();
+                    for (int i = 0; i < (int)instances.size(); i++)
                     {
-                        auto push_damage_child = [=] (const wf::region_t& damage)
+                        for (int j = 0; j < (int)instances[i].size(); j++)
                         {
-                            wf::region_t our_damage;
-                            for (auto& rect : damage)
+                            auto& thumb = thumbnails[i][j];
+                            const bool visible = range & wf::point_t{i, j};
+                            if (!visible && thumb.visible)
                             {
-                                wf::geometry_t box = wlr_box_from_pixman_box(rect);
-                                box = box + wf::origin(get_workspace_rect({i, j}));
-                                auto A = self->wall->viewport;
-                                auto B = self->get_bounding_box();
-                                our_damage |= scale_box(A, B, box);
+                                thumb.hidden_since = now;
                             }
 
-                            push_damage(our_damage);
-                        };
+                            thumb.visible = visible;
+                        }
+                    }
+
+                    visible_range = range;
+                    schedule_idle_release();
+                }
+
+                int budget = MAX_NEW_WORKSPACES_PER_FRAME;
+                bool waiting = false;
+                for (int i = visible_range.x; i < visible_range.x + visible_range.width; i++)
+                {
+                    for (int j = visible_range.y; j < visible_range.y + visible_range.height; j++)
+                    {
+                        if (thumbnails[i][j].has_instances)
+                        {
+                            continue;
+                        }
+
+                        if (budget > 0)
+                        {
+                            gen_workspace_instances(i, j);
+                            --budget;
+                        } else
+                        {
+                            waiting = true;
+                        }
 
-                        self->workspaces[i][j]->gen_render_instances(instances[i][j],
-                            push_damage_child, self->wall->output);
+                        new_workspaces_damage |= self->wall->wall_box_to_dock(
+                            get_workspace_rect({i, j}), self->get_bounding_box());
                     }
                 }
+
+                if (budget < MAX_NEW_WORKSPACES_PER_FRAME)
+                {
+                    // Damage cannot be pushed while the frame is being rendered.
+                    idle_push_new_workspaces.run_once([=] ()
+                    {
+                        push_damage(new_workspaces_damage);
+                        new_workspaces_damage.clear();
+                    });
+                } else if (!waiting)
+                {
+                    new_workspaces_damage.clear();
+                }
+            }
+
+            void schedule_idle_release()
+            {
+                if (self->wall->idle_release_timeout <= 0)
+                {
+                    release_idle_workspaces();
+                    return;
+                }
+
+                if (!release_timer.is_connected())
+                {
+                    release_timer.set_timeout(self->wall->idle_release_timeout, [=] ()
+                    {
+                        return release_idle_workspaces();
+                    });
+                }
             }
 
-            using render_tag = std::tuple<int, float>;
+            /**
+             * Release the workspaces which stayed outside of the viewport for
+             * longer than the wall's idle release timeout.
+             *
+             * @return Whether there are hidden workspaces which are kept still.
+             */
+            bool release_idle_workspaces()
+            {
+                const uint32_t now = wf::get_current_time();
+                bool remaining     = false;
+                for (int i = 0; i < (int)instances.size(); i++)
+                {
+                    for (int j = 0; j < (int)instances[i].size(); j++)
+                    {
+                        auto& thumb = thumbnails[i][j];
+                        if (thumb.visible || !thumb.has_instances)
+                        {
+                            continue;
+                        }
+
+                        if ((int)(now - thumb.hidden_since) >=
+                            self->wall->idle_release_timeout)
+                        {
+                            release_workspace_instances(i, j);
+                        } else
+                        {
+                            remaining = true;
+                        }
+                    }
+                }
+
+                return remaining;
+            }
+
+            using render_tag = std::tuple<int, float, wf::point_t>;
             static constexpr int TAG_BACKGROUND = 0;
-            static constexpr int TAG_WS_DIM     = 1;
             static constexpr int FRAME_EV = 2;
+            static constexpr int TAG_WS_THUMB   = 3;
+            static constexpr int TAG_WS_CACHED  = 4;
 
             void schedule_instructions(
                 std::vector<scene::render_instruction_t>& instructions,
                 const wf::render_target_t& target, wf::region_t& damage) override
             {
+                dock_timing::scoped_timer_t timer{self->wall->timing.schedule_instructions};
                 instructions.push_back(scene::render_instruction_t{
                         .instance = this,
                         .target   = target,
                         .damage   = wf::region_t{},
-                        .data     = render_tag{FRAME_EV, 0.0},
+                        .data     = render_tag{FRAME_EV, 0.0, {0, 0}},
                     });
 
-             // Scale damage to be in the workspace's coordinate system
-
-            wf::geometry_t sample_workspace = get_workspace_rect({0, 0});
-
-            wf::region_t workspaces_damage;
-            for (auto& rect : damage)
-            {
-                auto box = wlr_box_from_pixman_box(rect);
-                wf::geometry_t A = self->get_bounding_box();
-                wf::geometry_t B = self->wall->viewport;
+                update_visible_workspaces();
+                bucket_damage(target, damage);
+                for (int i = visible_range.x; i < visible_range.x + visible_range.width; i++)
+                {
+                    for (int j = visible_range.y; j < visible_range.y + visible_range.height; j++)
+                    {
+                        auto& our_damage = slots[slot_index({i, j})].damage;
+                        if (our_damage.empty())
+                        {
+                            continue;
+                        }
 
-                // Adjust the box by subtracting 300 from the x-coordinate
-                box.x -= sample_workspace.width/2;
-              //  box.width -= 300;
+                        if (!thumbnails[i][j].has_instances)
+                        {
+                            // Not set up yet, see update_visible_workspaces().
+                            // Until then, show the thumbnail from before the
+                            // node was last disabled, if there is one.
+                            const bool cached = self->has_thumbnail({i, j});
+                            instructions.push_back(scene::render_instruction_t{
+                                    .instance = this,
+                                    .target   = target,
+                                    .damage   = our_damage,
+                                    .data     = render_tag{
+                                        cached ? TAG_WS_CACHED : TAG_BACKGROUND,
+                                        self->wall->get_color_for_workspace({i, j}), {i, j}},
+                                });
+                            continue;
+                        }
 
-                workspaces_damage |= scale_box(A, B, box);
+                        // The thumbnail is dimmed while it is drawn, so the
+                        // workspace is not overdrawn by a separate dim pass.
+                        instructions.push_back(scene::render_instruction_t{
+                                .instance = this,
+                                .target   = target,
+                                .damage   = our_damage,
+                                .data     = render_tag{TAG_WS_THUMB,
+                                    self->wall->get_color_for_workspace({i, j}), {i, j}},
+                            });
+                    }
+                }
             }
 
+            /**
+             * Split the frame's damage into the dock slots of the visible
+             * workspaces.
+             *
+             * The slots form a regular grid, so each damage rectangle is mapped
+             * back to the wall once and only checked against the slots it can
+             * overlap, instead of intersecting the whole damage with every slot.
+             */
+            void bucket_damage(const wf::render_target_t& target, const wf::region_t& damage)
+            {
+                slots.resize(visible_range.width * visible_range.height);
+                for (int i = visible_range.x; i < visible_range.x + visible_range.width; i++)
+                {
+                    for (int j = visible_range.y; j < visible_range.y + visible_range.height; j++)
+                    {
+                        auto& slot = slots[slot_index({i, j})];
+                        slot.box = self->wall->wall_box_to_dock(get_workspace_rect({i, j}),
+                            target.geometry);
+                        slot.damage.clear();
+                    }
+                }
 
+                if (slots.empty())
+                {
+                    return;
+                }
 
+                auto output_size = self->wall->output->get_screen_size();
+                const int pitch_x = output_size.width + self->wall->gap_size;
+                const int pitch_y = output_size.height + self->wall->gap_size;
+                auto first_slot   = [] (int coord, int pitch)
+                {
+                    return (coord >= 0) ? coord / pitch : (coord - pitch + 1) / pitch;
+                };
 
-
-                for (int i = 0; i < (int)self->workspaces.size(); i++)
+                for (auto& rect : damage)
                 {
-                    for (int j = 0; j < (int)self->workspaces[i].size(); j++)
+                    auto box = wlr_box_from_pixman_box(rect);
+
+                    // Grow the box by a pixel to be safe from rounding, the exact
+                    // clipping is done against the slots.
+                    auto wall_box = self->wall->dock_box_to_wall(
+                        {box.x - 1, box.y - 1, box.width + 2, box.height + 2},
+                        target.geometry);
+
+                    const int x1 = std::max(visible_range.x,
+                        first_slot(wall_box.x, pitch_x));
+                    const int x2 = std::min(visible_range.x + visible_range.width - 1,
+                        first_slot(wall_box.x + wall_box.width - 1, pitch_x));
+                    const int y1 = std::max(visible_range.y,
+                        first_slot(wall_box.y, pitch_y));
+                    const int y2 = std::min(visible_range.y + visible_range.height - 1,
+                        first_slot(wall_box.y + wall_box.height - 1, pitch_y));
+
+                    for (int i = x1; i <= x2; i++)
                     {
-                        // Compute render target: a subbuffer of the target buffer
-                        // which corresponds to the region occupied by the
-                        // workspace.
-                        wf::render_target_t our_target = target;
-                        our_target.geometry =
-                            self->workspaces[i][j]->get_bounding_box();
-
-                        wf::geometry_t workspace_rect = get_workspace_rect({i, j});
-                        wf::geometry_t relative_to_viewport;
+                        for (int j = y1; j <= y2; j++)
+                        {
+                            auto& slot   = slots[slot_index({i, j})];
+                            auto clipped = wf::geometry_intersection(box, slot.box);
+                            if ((clipped.width > 0) && (clipped.height > 0))
+                            {
+                                slot.damage |= clipped;
+                            }
+                        }
+                    }
+                }
+            }
 
-                        relative_to_viewport= scale_box(
-                            self->wall->viewport, target.geometry,{ workspace_rect.x - workspace_rect.width/2,workspace_rect.y,workspace_rect.width,workspace_rect.height} /*workspace_rect*/);
+            /**
+             * Bring the thumbnail of the given workspace up to date.
+             *
+             * The workspace is rasterized at the size of its dock slot: the
+             * render target's scale is the slot's scale and not the output's,
+             * so that transformers and other nodes which render offscreen
+             * allocate their buffers at thumbnail resolution too.
+             *
+             * @param size The size of the thumbnail in framebuffer pixels.
+             */
+            void update_thumbnail(wf::point_t ws, wf::dimensions_t size)
+            {
+                auto& thumb = thumbnails[ws.x][ws.y];
+                auto ws_box = self->workspaces[ws.x][ws.y]->get_bounding_box();
 
-                        relative_to_viewport = add_offset_to_target(relative_to_viewport, workspace_rect.width/2, 0);
-                                         
-                        our_target.subbuffer = target.framebuffer_box_from_geometry_box(relative_to_viewport);
+                OpenGL::render_begin();
+                auto& fb = self->thumbnail_buffers[ws.x][ws.y];
+                if (fb.allocate(size.width, size.height))
+                {
+                    thumb.damage |= ws_box;
+                }
 
-                        wf::geometry_t workspace_rect2;
-                        workspace_rect2.x = workspace_rect.x - workspace_rect.width/2 ;
-                        workspace_rect2.y = workspace_rect.y;
-                        workspace_rect2.width = workspace_rect.width;
-                        workspace_rect2.height = workspace_rect.height;
+                OpenGL::render_end();
 
-                        // Take the damage for the workspace in workspace-local coordindates, as the workspace
-                        // stream node expects.
-                        wf::region_t our_damage = workspaces_damage & workspace_rect2;
-                          // Adjust the damage here with - workspace_rect.width/2
-                        // Assuming our_damage is in a coordinate system compatible with the offset
+                if (thumb.damage.empty())
+                {
+                    return;
+                }
 
-                        workspaces_damage ^= our_damage;
-                        our_damage += -wf::origin(workspace_rect2);
+                const float lod_scale = std::min(1.0 * size.width / ws_box.width,
+                    1.0 * size.height / ws_box.height);
 
+                // A workspace pixel is smaller than a thumbnail pixel, so grow
+                // the damage to cover the partially damaged thumbnail pixels.
+                const int pad = std::ceil(1.0 / lod_scale);
+                wf::region_t padded;
+                for (auto& rect : thumb.damage)
+                {
+                    auto box = wlr_box_from_pixman_box(rect);
+                    padded |= wf::geometry_t{box.x - pad, box.y - pad,
+                        box.width + 2 * pad, box.height + 2 * pad};
+                }
 
+                thumb.damage = self->wall->simplify_damage(padded & ws_box);
 
-                        // Dim workspaces at the end (the first instruction pushed is executed last)
-                        instructions.push_back(scene::render_instruction_t{
-                                .instance = this,
-                                .target   = our_target,
-                                .damage   = our_damage ,
-                                .data     = render_tag{TAG_WS_DIM,
-                                    self->wall->get_color_for_workspace({i, j})},
-                            });
+                // The scale has to map ws_box onto the slot-sized buffer. With
+                // the output's scale, the scissor boxes of partial damage would
+                // land outside of the buffer.
+                wf::render_target_t thumb_target{fb};
+                thumb_target.geometry  = ws_box;
+                thumb_target.scale     = lod_scale;
+                thumb_target.subbuffer = wf::geometry_t{0, 0, size.width, size.height};
 
-                        // Render the workspace contents first
-                        for (auto& ch : instances[i][j])
-                        {
-                            ch->schedule_instructions(instructions, our_target, our_damage);
-                        }
-                    }
+                auto& ws_state = self->wall->ws_state;
+                std::optional<dock_timing::scoped_timer_t> timer;
+                if (ws_state.contains(ws))
+                {
+                    timer.emplace(ws_state.thumbnail_time[ws_state.index(ws)]);
                 }
 
- /*               auto bbox = self->get_bounding_box();
+                scene::render_pass_params_t params;
+                params.instances = &instances[ws.x][ws.y];
+                params.target    = thumb_target;
+                params.damage    = thumb.damage;
+                params.background_color = self->wall->background_color;
+                params.reference_output = self->wall->output;
+                scene::run_render_pass(params, scene::RPASS_CLEAR_BACKGROUND);
 
-                instructions.push_back(scene::render_instruction_t{
-                        .instance = this,
-                        .target   = target,
-                        .damage   = damage & self->get_bounding_box(),
-                        .data     = render_tag{TAG_BACKGROUND, 0.0},
-                    });
-
-                damage ^= bbox;
-*/            }
+                thumb.damage.clear();
+            }
 
             void render(const wf::render_target_t& target,
                 const wf::region_t& region, const std::any& any_tag) override
             {
-                auto [tag, dim] = std::any_cast<render_tag>(any_tag);
+                auto [tag, dim, ws] = std::any_cast<render_tag>(any_tag);
+
+                auto& timing = self->wall->timing;
+                dock_timing::scoped_timer_t timer{
+                    (tag == TAG_BACKGROUND) ? timing.background :
+                    (tag == FRAME_EV) ? timing.frame_event : timing.thumbnail};
 
                 if (tag == TAG_BACKGROUND)
                 {
@@ -464,18 +1196,25 @@ class workspace_wall_t : public wf::signal::provider_t
                 } else if (tag == FRAME_EV)
                 {
                     self->wall->render_wall(target, region);
-                } else
+                } else if ((tag == TAG_WS_THUMB) || (tag == TAG_WS_CACHED))
                 {
-                    auto fb_region = target.framebuffer_region_from_geometry_region(region);
+                    auto dock_box = self->wall->wall_box_to_dock(
+                        get_workspace_rect(ws), target.geometry);
+                    if (tag == TAG_WS_THUMB)
+                    {
+                        update_thumbnail(ws, {
+                            std::max(1, (int)std::ceil(dock_box.width * target.scale)),
+                            std::max(1, (int)std::ceil(dock_box.height * target.scale)),
+                        });
+                    }
 
+                    wf::texture_t tex{self->thumbnail_buffers[ws.x][ws.y].tex};
                     OpenGL::render_begin(target);
-                    for (auto& dmg_rect : fb_region)
+                    for (auto& rect : region)
                     {
-                        target.scissor(wlr_box_from_pixman_box(dmg_rect));
-                        const float a = 1.0 - dim;
-
-                        OpenGL::render_rectangle(target.geometry, {0, 0, 0, a},
-                            target.get_orthographic_projection());
+                        target.logic_scissor(wlr_box_from_pixman_box(rect));
+                        OpenGL::render_texture(tex, target, dock_box,
+                            glm::vec4(dim, dim, dim, 1.0));
                     }
 
                     OpenGL::render_end();
@@ -484,9 +1223,9 @@ class workspace_wall_t : public wf::signal::provider_t
 
             void compute_visibility(wf::output_t *output, wf::region_t& visible) override
             {
-                for (int i = 0; i < (int)self->workspaces.size(); i++)
+                for (int i = visible_range.x; i < visible_range.x + visible_range.width; i++)
                 {
-                    for (int j = 0; j < (int)self->workspaces[i].size(); j++)
+                    for (int j = visible_range.y; j < visible_range.y + visible_range.height; j++)
                     {
                         wf::region_t ws_region = self->workspaces[i][j]->get_bounding_box();
                         for (auto& ch : this->instances[i][j])
@@ -512,9 +1251,40 @@ class workspace_wall_t : public wf::signal::provider_t
                         wall->output, wf::point_t{i, j});
                     workspaces[i].push_back(node);
                 }
+
+                thumbnail_buffers.emplace_back(h);
             }
         }
 
+        ~workspace_wall_node_t()
+        {
+            OpenGL::render_begin();
+            for (auto& column : thumbnail_buffers)
+            {
+                for (auto& fb : column)
+                {
+                    fb.release();
+                }
+            }
+
+            OpenGL::render_end();
+        }
+
+        /**
+         * Check whether the thumbnail of a workspace holds a rendered image,
+         * possibly from before the node was disabled.
+         */
+        bool has_thumbnail(wf::point_t ws) const
+        {
+            return thumbnail_buffers[ws.x][ws.y].tex != (GLuint)-1;
+        }
+
+        wf::dimensions_t get_grid_size() const
+        {
+            return {(int)workspaces.size(),
+                workspaces.empty() ? 0 : (int)workspaces[0].size()};
+        }
+
         virtual void gen_render_instances(
             std::vector<scene::render_instance_uptr>& instances,
             scene::damage_callback push_damage, wf::output_t *shown_on) override
@@ -541,7 +1311,22 @@ class workspace_wall_t : public wf::signal::provider_t
       private:
         workspace_wall_t *wall;
         std::vector<std::vector<std::shared_ptr<workspace_stream_node_t>>> workspaces;
+
+        /* The thumbnails of the workspaces. They belong to the node and not to
+         * its render instance, so that they survive the regeneration of the
+         * render instances, e.g when the node is disabled and enabled again. */
+        std::vector<std::vector<wf::framebuffer_base_t>> thumbnail_buffers;
     };
     std::shared_ptr<workspace_wall_node_t> render_node;
+    bool persistent = false;
+
+    void destroy_render_node()
+    {
+        if (render_node)
+        {
+            scene::remove_child(render_node);
+            render_node = nullptr;
+        }
+    }
 };
 }
@@ -22,12 +22,17 @@ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
 LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.*/
+#include <cmath>
 #include <memory>
+#include <optional>
 #include <wayfire/core.hpp>
 #include <wayfire/debug.hpp>
 #include <wayfire/output-layout.hpp>
 #include <wayfire/output.hpp>
 #include <wayfire/per-output-plugin.hpp>
+#include <wayfire/plugins/common/dock-timing.hpp>
+#include <wayfire/plugins/common/dock-trace.hpp>
+#include <wayfire/plugins/common/dock-view-index.hpp>
 #include <wayfire/plugins/common/geometry-animation.hpp>
 #include <wayfire/plugins/common/key-repeat.hpp>
 #include <wayfire/plugins/common/move-drag-interface.hpp>
@@ -35,6 +40,8 @@ SOFTWARE.*/
 #include <wayfire/plugins/common/workspace-wall.hpp>
 
 #include "plugins/ipc/ipc-activator.hpp"
+#include "plugins/ipc/ipc-helpers.hpp"
+#include "plugins/ipc/ipc-method-repository.hpp"
 #include "wayfire/plugins/common/input-grab.hpp"
 #include "wayfire/plugins/common/util.hpp"
 #include "wayfire/render-manager.hpp"
@@ -46,85 +53,205 @@ SOFTWARE.*/
 /* TODO: this file should be included in some header maybe(plugin.hpp) */
 #include <linux/input-event-codes.h>
 
-bool dragging_window = false;
-bool grab_check = false;
-bool main_workspace = false;
-int animation = 1;
+/**
+ * Maps output-local input coordinates over the dock to coordinates relative
+ * to the first workspace of the wall (i.e (0,0)).
+ *
+ * The mapping only depends on the output size and the workspace grid, so it
+ * is computed once and rebuilt only when one of those changes instead of on
+ * every pointer or touch event.
+ */
+class dock_input_transform_t {
+ public:
+  void invalidate() { valid = false; }
+  bool is_valid() const { return valid; }
+
+  void rebuild(wf::output_t* output) {
+    auto og = output->get_layout_geometry();
+    auto size = output->get_screen_size();
+    auto wsize = output->wset()->get_workspace_grid_size();
+    const double max = std::max(wsize.width, wsize.height);
+
+    // The wall is centered in a max x max grid and scaled down onto the
+    // output, then moved right so that its last column is the dock.
+    origin_x = og.width * (max - wsize.width) / max / 2 + size.width / 2 -
+               size.width / wsize.height / 2;
+    origin_y = og.height * (max - wsize.height) / max / 2;
+    scale = max;
+
+    workspace_size = {og.width, og.height};
+    grid = {0, 0, og.width * wsize.width, og.height * wsize.height};
+    valid = true;
+  }
+
+  wf::point_t to_global(wf::point_t local) const {
+    return {
+        (int)std::floor((local.x - origin_x) * scale),
+        (int)std::floor((local.y - origin_y) * scale),
+    };
+  }
+
+  /** The workspace which contains the given global point. */
+  wf::point_t workspace_at(wf::point_t global) const {
+    return {global.x / workspace_size.width, global.y / workspace_size.height};
+  }
+
+  /** The bounds of the whole workspace grid in global coordinates. */
+  const wf::geometry_t& get_grid() const { return grid; }
+
+ private:
+  bool valid = false;
+  double origin_x = 0;
+  double origin_y = 0;
+  double scale = 1;
+  wf::dimensions_t workspace_size = {1, 1};
+  wf::geometry_t grid = {0, 0, 0, 0};
+};
 
 class wayfire_expo : public wf::per_output_plugin_instance_t,
                      public wf::keyboard_interaction_t,
                      public wf::pointer_interaction_t,
                      public wf::touch_interaction_t {
  private:
-  // Function to print cursor position
-  void CursorPos(const wf::pointf_t& cursor_position) {
-   // printf("CursorPos \n");
-    auto size = output->get_screen_size();
+  /**
+   * Where the pointer is with respect to the dock. The grab and the plugin
+   * activation only change on transitions between these states, never while
+   * the pointer moves inside one of them.
+   */
+  enum class hot_zone_t {
+    // The pointer is over the desktop, the dock does not grab input.
+    DESKTOP,
+    // The pointer is over the dock, which grabs input.
+    DOCK,
+    // A window is being dragged, the grab is kept wherever the pointer goes.
+    DRAGGING,
+  };
+
+  hot_zone_t hot_zone = hot_zone_t::DESKTOP;
+
+  // The zone which was left when the current drag started.
+  hot_zone_t hot_zone_before_drag = hot_zone_t::DESKTOP;
 
+  // Whether the current drop target is the main desktop instead of a
+  // workspace in the dock.
+  bool main_workspace = false;
+
+  // The zoom animation style: 0 zooms between the current workspace and the
+  // whole wall, 1 slides the wall in from the side.
+  int animation = 1;
+  wf::wl_timer<false> hot_zone_dwell_timer;
+
+  /** The output-local x coordinate where the dock begins. */
+  double get_dock_edge() {
+    auto size = output->get_screen_size();
     auto wsize = output->wset()->get_workspace_grid_size();
-    auto workspaces_horizontal = wsize.width;
-    int deskstopsY = wsize.height;
+    return size.width - size.width / wsize.height;
+  }
 
-    if (cursor_position.x > size.width - size.width / deskstopsY) {
-   //   printf("dock detected \n");
+  /**
+   * Check whether the pointer is over this output's dock. The hysteresis is
+   * applied against the current zone, so that the pointer has to move past
+   * the edge by hot_zone_hysteresis pixels in either direction.
+   */
+  bool is_pointer_in_dock() {
+    auto cursor_position = wf::get_core().get_cursor_position();
+    auto og = output->get_layout_geometry();
+    if (!(og & cursor_position)) {
+      return false;
+    }
 
-      if (grab_check == false) {
-                printf("dock detected \n");
-                printf("grab check = false\n");
-        output->activate_plugin(&grab_interface);
-                printf("output->activate_plugin(&grab_interface);\n");
-        input_grab->ungrab_input();
-                printf(" input_grab->ungrab_input()\n");
-        input_grab = std::make_unique<wf::input_grab_t>("expo", output, this,
-                                                        this, this);
-                printf("input_grab = std::make_unique<wf::input_grab_t;\n");
-        input_grab->grab_input(wf::scene::layer::WORKSPACE);
-                printf("input_grab->grab_input(wf::scene::layer::WORKSPACE);\n");
-        state.active = true;
-                printf(" state.active = true;\n");
-        state.button_pressed = false;
-                printf("state.button_pressed = false;\n");
-        state.accepting_input = true;
-                printf("state.accepting_input = true;\n");
-        main_workspace = false;
-                printf("main_workspace = false;\n");
-        grab_check = true;
-                printf("grab check = true\n");
-                printf("\n");
-      }
-    } else if (cursor_position.x <= size.width - size.width / deskstopsY) {
-    //  printf("desktop detected \n");
-
-      if (grab_check == false) {
-                printf("desktop detected \n");
-                printf("grab check = false\n");
-        main_workspace = true;
-                printf(" main_workspace = true;\n");
-        input_grab->ungrab_input();
-                printf("input_grab->ungrab_input()\n");
-     main_workspace = false;
+    const double x = cursor_position.x - og.x;
+    const double edge = get_dock_edge();
+    return (hot_zone == hot_zone_t::DOCK) ? x >= edge - hot_zone_hysteresis
+                                          : x > edge + hot_zone_hysteresis;
+  }
 
-        output->deactivate_plugin(&grab_interface);
-        
-                printf(" output->deactivate_plugin(&grab_interface);\n");
+  /**
+   * Check whether the pointer crossed the dock edge and switch the hot-zone
+   * if it did. The pointer has to be hot_zone_hysteresis pixels past the edge,
+   * and stay in the dock for hot_zone_dwell milliseconds before it is grabbed.
+   */
+  void update_hot_zone() {
+    if (hot_zone == hot_zone_t::DRAGGING) {
+      return;
+    }
+
+    const bool in_dock = is_pointer_in_dock();
+    if (in_dock == (hot_zone == hot_zone_t::DOCK)) {
+      hot_zone_dwell_timer.disconnect();
+      return;
+    }
+
+    if (!in_dock) {
+      set_hot_zone(hot_zone_t::DESKTOP);
+    } else if (hot_zone_dwell <= 0) {
+      set_hot_zone(hot_zone_t::DOCK);
+    } else if (!hot_zone_dwell_timer.is_connected()) {
+      hot_zone_dwell_timer.set_timeout(hot_zone_dwell, [=]() {
+        update_hot_zone_after_dwell();
+      });
+    }
+  }
 
-                 state.active = true;
-                printf(" state.active = true;\n");
+  void update_hot_zone_after_dwell() {
+    if ((hot_zone == hot_zone_t::DESKTOP) && is_pointer_in_dock()) {
+      set_hot_zone(hot_zone_t::DOCK);
+    }
+  }
+
+  void set_hot_zone(hot_zone_t zone) {
+    if (zone == hot_zone) {
+      return;
+    }
+
+    DOCK_TRACE(DEBUG, INPUT, "hot-zone %d -> %d", (int)hot_zone, (int)zone);
+    hot_zone_dwell_timer.disconnect();
+    switch (zone) {
+      case hot_zone_t::DOCK:
+        if (hot_zone == hot_zone_t::DESKTOP) {
+          if (!output->activate_plugin(&grab_interface)) {
+            return;
+          }
+
+          input_grab->grab_input(wf::scene::layer::WORKSPACE);
+          state.button_pressed = false;
+          state.accepting_input = true;
+        }
+
+        break;
+
+      case hot_zone_t::DESKTOP:
+        input_grab->ungrab_input();
+        output->deactivate_plugin(&grab_interface);
         state.button_pressed = false;
-                printf("state.button_pressed = false;\n");
         state.accepting_input = true;
-                printf("state.accepting_input = true;\n");
+        break;
 
+      case hot_zone_t::DRAGGING:
+        hot_zone_before_drag = hot_zone;
+        break;
+    }
 
-        this->state.button_pressed = false;
-                printf("this->state.button_pressed = false;\n");
-                printf("\n");
-      }
+    hot_zone = zone;
+  }
+
+  /**
+   * A drag ended, go back to the zone under the pointer. The transition is
+   * made from the zone the drag started in, so a drag which started on the
+   * desktop and ends over the dock grabs the input, and one which started in
+   * the dock and ends over the desktop releases it. The dwell time is not
+   * applied, the user is already interacting with the dock.
+   */
+  void end_dragging() {
+    if (hot_zone != hot_zone_t::DRAGGING) {
+      return;
     }
+
+    hot_zone = hot_zone_before_drag;
+    set_hot_zone(is_pointer_in_dock() ? hot_zone_t::DOCK : hot_zone_t::DESKTOP);
   }
 
   wf::point_t convert_workspace_index_to_coords(int index) {
-    printf("convert_workspace_index_to_coords \n");
     index--;  // compensate for indexing from 0
     auto wsize = output->wset()->get_workspace_grid_size();
     int x = index % wsize.width;
@@ -139,6 +266,15 @@ class wayfire_expo : public wf::per_output_plugin_instance_t,
   wf::option_wrapper_t<bool> keyboard_interaction{"expo/keyboard_interaction"};
   wf::option_wrapper_t<double> inactive_brightness{"expo/inactive_brightness"};
   wf::option_wrapper_t<int> transition_length{"expo/transition_length"};
+  wf::option_wrapper_t<int> thumbnail_refresh_rate{
+      "expo/thumbnail_refresh_rate"};
+  wf::option_wrapper_t<int> thumbnail_release_delay{
+      "expo/thumbnail_release_delay"};
+  wf::option_wrapper_t<bool> coalesce_motion{"expo/coalesce_motion"};
+  wf::option_wrapper_t<int> max_damage_rects{"expo/max_damage_rects"};
+  wf::option_wrapper_t<bool> persistent_dock{"expo/persistent_dock"};
+  wf::option_wrapper_t<int> hot_zone_hysteresis{"expo/hot_zone_hysteresis"};
+  wf::option_wrapper_t<int> hot_zone_dwell{"expo/hot_zone_dwell"};
   wf::geometry_animation_t zoom_animation{zoom_duration};
 
   wf::option_wrapper_t<bool> move_enable_snap_off{"move/enable_snap_off"};
@@ -163,12 +299,11 @@ class wayfire_expo : public wf::per_output_plugin_instance_t,
 
   wf::point_t target_ws, initial_ws;
   std::unique_ptr<wf::workspace_wall_t> wall;
+  std::unique_ptr<wf::dock_view_index_t> view_index;
 
   wf::key_repeat_t key_repeat;
   uint32_t key_pressed = 0;
 
-  /* fade animations for each workspace */
-  std::vector<std::vector<wf::animation::simple_animation_t>> ws_fade;
   std::unique_ptr<wf::input_grab_t> input_grab;
 
  public:
@@ -178,7 +313,6 @@ class wayfire_expo : public wf::per_output_plugin_instance_t,
   // activation/deactivation.
 
   void setup_workspace_bindings_from_config() {
-    printf("setup_workspace_bindings_from_config \n");
     for (const auto& [workspace, binding] : workspace_bindings.value()) {
       int workspace_index = atoi(workspace.c_str());
       auto wsize = output->wset()->get_workspace_grid_size();
@@ -224,12 +358,13 @@ class wayfire_expo : public wf::per_output_plugin_instance_t,
   void init() override {
 
 
-    printf(" init \n");
+    DOCK_TRACE(INFO, RENDER, "init on %s", output->to_string().c_str());
     input_grab =
         std::make_unique<wf::input_grab_t>("expo", output, this, this, this);
 
     setup_workspace_bindings_from_config();
     wall = std::make_unique<wf::workspace_wall_t>(this->output);
+    view_index = std::make_unique<wf::dock_view_index_t>(this->output);
 
     drag_helper->connect(&on_drag_output_focus);
     drag_helper->connect(&on_drag_snap_off);
@@ -238,9 +373,10 @@ class wayfire_expo : public wf::per_output_plugin_instance_t,
 
     resize_ws_fade();
     output->connect(&on_workspace_grid_changed);
+    output->connect(&on_output_config_changed);
   }
   bool handle_toggle() {
-    printf(" handle_toggle \n");
+    DOCK_TRACE(DEBUG, RENDER, "toggle, active: %d", state.active);
     if (!state.active) {
       return activate();
     } else if (!zoom_animation.running() || state.zoom_in) {
@@ -251,11 +387,13 @@ class wayfire_expo : public wf::per_output_plugin_instance_t,
   }
 #//for mouse
   void handle_pointer_button(const wlr_pointer_button_event& event) override {
-    printf(" handle_pointer_button \n");
+    DOCK_TRACE(TRACE, INPUT, "pointer button %u state %d", event.button,
+               (int)event.state);
     if (event.button != BTN_LEFT) {
       return;
     }
 
+    flush_pending_motion();
     auto gc = output->get_cursor_position();
     handle_input_press(gc.x, gc.y, event.state);
   }
@@ -263,39 +401,7 @@ class wayfire_expo : public wf::per_output_plugin_instance_t,
   int xdesktops;
   void handle_pointer_motion(wf::pointf_t pointer_position,
                              uint32_t time_ms) override {
-    printf(" handle_pointer_motion \n");
-    auto size = output->get_screen_size();
-
-    auto wsize = output->wset()->get_workspace_grid_size();
-    auto workspaces_horizontal = wsize.width;
-    int deskstopsY = wsize.height;
-
-    // /  printf("sx.x = %d, sy.y = %d\n", (int)pointer_position.x,
-    // (int)pointer_position.y);
-    if ((int)pointer_position.x <= size.width - size.width / deskstopsY &&
-        dragging_window == false)
-
-    {
-      input_grab->ungrab_input();
-      // input_grab->grab_input(wf::scene::layer::WORKSPACE);
-      // input_grab->set_wants_raw_input(true);
-
-      // output->deactivate_plugin(&grab_interface);//
-      grab_check = false;
-
-      printf("at desktop sx.x = %d, sy.y = %d\n", (int)pointer_position.x,
-             (int)pointer_position.y);
-    } else if ((int)pointer_position.x > size.width - size.width / deskstopsY &&
-               dragging_window == false) {
-      //   input_grab->grab_input(wf::scene::layer::OVERLAY);
-      // state.active = true;
-      // state.button_pressed  = false;
-      //   state.accepting_input = true;
-      grab_check = false;
-      printf("at remote view sx.x = %d, sy.y = %d\n", (int)pointer_position.x,
-             (int)pointer_position.y);
-    }
-    handle_input_move({(int)pointer_position.x, (int)pointer_position.y});
+    queue_input_move({(int)pointer_position.x, (int)pointer_position.y});
   }
   // for keyboard
       void handle_keyboard_key(wf::seat_t*, wlr_keyboard_key_event event)
@@ -323,6 +429,7 @@ class wayfire_expo : public wf::per_output_plugin_instance_t,
       return;
     }
 
+    flush_pending_motion();
     auto og = output->get_layout_geometry();
     handle_input_press(position.x - og.x, position.y - og.y,
                        WLR_BUTTON_PRESSED);
@@ -334,6 +441,7 @@ class wayfire_expo : public wf::per_output_plugin_instance_t,
       return;
     }
 
+    flush_pending_motion();
     handle_input_press(0, 0, WLR_BUTTON_RELEASED);
   }
 
@@ -344,7 +452,38 @@ class wayfire_expo : public wf::per_output_plugin_instance_t,
       return;
     }
 
-    handle_input_move({(int)position.x, (int)position.y});
+    queue_input_move({(int)position.x, (int)position.y});
+  }
+
+  /**
+   * The latest motion position which was not yet processed, when motion is
+   * coalesced to one update per frame.
+   */
+  std::optional<wf::point_t> pending_motion;
+
+  void queue_input_move(wf::point_t to) {
+    if (!coalesce_motion) {
+      handle_input_move(to);
+      return;
+    }
+
+    if (!pending_motion) {
+      output->render->schedule_redraw();
+    }
+
+    pending_motion = to;
+  }
+
+  /**
+   * Process the pending motion, if any. Called once per frame and before
+   * presses and releases, so that they see the exact pointer position.
+   */
+  void flush_pending_motion() {
+    if (pending_motion) {
+      auto to = *pending_motion;
+      pending_motion.reset();
+      handle_input_move(to);
+    }
   }
 
   bool can_handle_drag() {
@@ -369,7 +508,21 @@ class wayfire_expo : public wf::per_output_plugin_instance_t,
           input_grab->set_wants_raw_input(true);
         }
 
-        dragging_window = true;
+        // Drags of the move plugin arrive here too, a hidden dock must not
+        // take part in them, or it would grab the input on drag end.
+        if (!state.active) {
+          return;
+        }
+
+        // Each output's dock follows only the part of the drag which happens
+        // on that output.
+        if (ev->focus_output == output) {
+          set_hot_zone(hot_zone_t::DRAGGING);
+        } else if (ev->previous_focus_output == output) {
+          end_dragging();
+          input_grab->set_wants_raw_input(false);
+          state.button_pressed = false;
+        }
       };
 
   // This code appears to handle the completion of a move drag operation,
@@ -379,17 +532,23 @@ class wayfire_expo : public wf::per_output_plugin_instance_t,
         if ((ev->focus_output == output) && can_handle_drag()) {
           wf::move_drag::adjust_view_on_snap_off(drag_helper->view);
         }
-
-        dragging_window = false;
       };
 
   wf::signal::connection_t<wf::move_drag::drag_done_signal> on_drag_done =
       [=](wf::move_drag::drag_done_signal* ev) {
+        // Drags which end on other outputs are handled by their docks, this
+        // one already left the drag when the drag focus moved away.
+        if (ev->focused_output != output) {
+          return;
+        }
+
         // Code executed when the move drag operation is done
-        dragging_window = false;
+        if (state.active) {
+          end_dragging();
+        }
+
         // Check conditions to handle the drag
-        if ((ev->focused_output == output) && can_handle_drag() &&
-            !drag_helper->is_view_held_in_place()) {
+        if (can_handle_drag() && !drag_helper->is_view_held_in_place()) {
           // Check if the dragged view is on the same output
           bool same_output = ev->main_view->get_output() == output;
 
@@ -437,35 +596,35 @@ class wayfire_expo : public wf::per_output_plugin_instance_t,
       };
 
   bool activate() {
-    printf("   bool activate \n");
-
+    DOCK_TRACE(DEBUG, RENDER, "activate");
     if (!output->activate_plugin(&grab_interface)) {
       return false;
     }
 
     input_grab->grab_input(wf::scene::layer::OVERLAY);
+    hot_zone = hot_zone_t::DOCK;
     state.active = true;
     state.button_pressed = false;
     state.accepting_input = true;
     start_zoom(true);
 
-    printf("   bool activate returned \n");
-
-    printf("   bool activate start output \n");
     auto cws = output->wset()->get_current_workspace();
-    printf(" output->wset()->get_current_workspace( \n");
     initial_ws = target_ws = cws;
 
+    wall->set_background_refresh_rate(thumbnail_refresh_rate);
+    wall->set_idle_release_timeout(thumbnail_release_delay);
+    wall->set_max_damage_rects(max_damage_rects);
+    wall->set_persistent(persistent_dock);
+    update_live_workspaces();
     wall->start_output_renderer();
 
-    printf(" output->wset()->get_current_workspace( \n");
     output->render->add_effect(&pre_frame, wf::OUTPUT_EFFECT_PRE);
-
-    printf("   bool activate add effect \n");
+    output->render->add_effect(&post_frame, wf::OUTPUT_EFFECT_POST);
+    wf::get_core().connect(&on_pointer_motion);
+    wf::get_core().connect(&on_pointer_motion_absolute);
+    view_index->connect();
     output->render->schedule_redraw();
 
-    printf("   bool activate schedule_redraw \n");
-
     //    auto cws = output->wset()->get_current_workspace();
     //     initial_ws = target_ws = cws;
 
@@ -480,7 +639,7 @@ class wayfire_expo : public wf::per_output_plugin_instance_t,
   }
 
   void start_zoom(bool zoom_in) {
-    printf("   start_zoom \n");
+    DOCK_TRACE(DEBUG, RENDER, "start zoom, zoom in: %d", zoom_in);
     wall->set_background_color(background_color);
     wall->set_gap_size(this->delimiter_offset);
     //  float zoom_factor = zoom_in ? 3.5 : 0.5;
@@ -580,7 +739,7 @@ class wayfire_expo : public wf::per_output_plugin_instance_t,
   }
 
   void finish_zoom(bool zoom_in) {
-    printf("   start_zoom \n");
+    DOCK_TRACE(DEBUG, RENDER, "finish zoom, zoom in: %d", zoom_in);
     wall->set_background_color(background_color);
     wall->set_gap_size(this->delimiter_offset);
     //  float zoom_factor = zoom_in ? 3.5 : 0.5;
@@ -685,12 +844,12 @@ class wayfire_expo : public wf::per_output_plugin_instance_t,
   }
 
   void deactivate() {
-    printf("deactivate\n");
+    DOCK_TRACE(DEBUG, RENDER, "deactivate");
 
     if (main_workspace == false && target_ws != initial_ws) {
       state.accepting_input = false;
       start_zoom(false);
-    } else if (main_workspace == true && dragging_window == false &&
+    } else if (main_workspace == true && hot_zone != hot_zone_t::DRAGGING &&
                target_ws == initial_ws) {
       state.accepting_input = true;
       start_zoom(true);
@@ -704,18 +863,7 @@ class wayfire_expo : public wf::per_output_plugin_instance_t,
   }
 
   wf::geometry_t get_grid_geometry() {
-    auto wsize = output->wset()->get_workspace_grid_size();
-    auto full_g = output->get_layout_geometry();
-
-    wf::geometry_t grid;
-    grid.x = grid.y = 0;
-    grid.width = full_g.width * wsize.width;
-    grid.height = full_g.height * wsize.height;
-
-    //   printf("grid.width  %d grid.height %d",grid.width, grid.height  );
-    //  printf("full_g.width  %d full_g.height %d",full_g.width, full_g.height
-    //  );
-    return grid;
+    return get_input_transform().get_grid();
   }
 
   wf::point_t input_grab_origin;
@@ -741,7 +889,7 @@ class wayfire_expo : public wf::per_output_plugin_instance_t,
 
       input_grab_origin = {x, y};
       update_target_workspace(x, y);
-      printf("handle_input_press x = %d, sy.y = %d\n", x, y);
+      DOCK_TRACE(DEBUG, INPUT, "press at %d,%d", x, y);
     }
   }
   // The start_moving function you provided is designed to initiate the movement
@@ -750,7 +898,8 @@ class wayfire_expo : public wf::per_output_plugin_instance_t,
   // hierarchy and usually correspond to individual application windows.
 
   void start_moving(wayfire_toplevel_view view, wf::point_t grab) {
-    printf("start_moving\n");
+    DOCK_TRACE(DEBUG, DRAG, "start moving view %s at %d,%d",
+               view->to_string().c_str(), grab.x, grab.y);
     if (!(view->get_allowed_actions() &
           (wf::VIEW_ALLOW_WS_CHANGE | wf::VIEW_ALLOW_MOVE))) {
       return;
@@ -786,7 +935,6 @@ class wayfire_expo : public wf::per_output_plugin_instance_t,
   // this is whre it drag a window about
   const wf::point_t offscreen_point = {-10, -10};
   void handle_input_move(wf::point_t to) {
-    printf(" handle_input_move\n");
     if (!state.button_pressed) {
       /*
               if (abs(local - input_grab_origin) < 5)
@@ -795,14 +943,15 @@ class wayfire_expo : public wf::per_output_plugin_instance_t,
                   return;
               }
       */
-      if (dragging_window == true || main_workspace == true) {
+      if (hot_zone == hot_zone_t::DRAGGING || main_workspace == true) {
         auto local = to - wf::origin(output->get_layout_geometry());
 
         if (drag_helper->view) {  //
           drag_helper->handle_motion(to);
         }
 
-        LOGI("Motion is ", to, " ", input_grab_origin);
+        DOCK_TRACE(TRACE, INPUT, "motion to %d,%d, grab origin %d,%d", to.x,
+                   to.y, input_grab_origin.x, input_grab_origin.y);
 
         bool first_click = (input_grab_origin != offscreen_point);
         if (!zoom_animation.running()) {
@@ -822,7 +971,7 @@ class wayfire_expo : public wf::per_output_plugin_instance_t,
       return;
     }
 
-    dragging_window = true;
+    set_hot_zone(hot_zone_t::DRAGGING);
 
     auto local = to - wf::origin(output->get_layout_geometry());
 
@@ -830,7 +979,8 @@ class wayfire_expo : public wf::per_output_plugin_instance_t,
       drag_helper->handle_motion(to);
     }
 
-    LOGI("Motion is ", to, " ", input_grab_origin);
+    DOCK_TRACE(TRACE, INPUT, "motion to %d,%d, grab origin %d,%d", to.x, to.y,
+               input_grab_origin.x, input_grab_origin.y);
 
     if (abs(local - input_grab_origin) < 5) {
       /* Ignore small movements */
@@ -857,7 +1007,6 @@ class wayfire_expo : public wf::per_output_plugin_instance_t,
    * Helper to determine if keyboard presses should be handled
    */
   bool should_handle_key() {
-    printf("should_handle_key\n");
     return state.accepting_input && keyboard_interaction &&
            !state.button_pressed;
   }
@@ -949,12 +1098,32 @@ class wayfire_expo : public wf::per_output_plugin_instance_t,
     }
   }
 
+  /**
+   * The current workspace and the one under the pointer (or selected with the
+   * keyboard) are updated live in the dock, all others at the configured
+   * thumbnail refresh rate.
+   */
+  void update_live_workspaces() {
+    wall->set_live_workspaces(
+        {output->wset()->get_current_workspace(), target_ws});
+  }
+
   /**
    * start an animation for shading the given workspace
    */
   void shade_workspace(const wf::point_t& ws, bool shaded) {
+    if (!shaded) {
+      // Unshading happens whenever target_ws changes.
+      update_live_workspaces();
+    }
+
     double target = shaded ? inactive_brightness : 1.0;
-    auto& anim = ws_fade.at(ws.x).at(ws.y);
+    auto& ws_state = wall->get_workspace_state();
+    if (!ws_state.contains(ws)) {
+      return;
+    }
+
+    auto& anim = ws_state.fade[ws_state.index(ws)];
 
     if (anim.running()) {
       anim.animate(target);
@@ -972,33 +1141,30 @@ class wayfire_expo : public wf::per_output_plugin_instance_t,
    * to coordinates relative to the first workspace (i.e (0,0))
    */
   void input_coordinates_to_global_coordinates(int& sx, int& sy) {
-    printf("sx.x = %f,sy.y =%f/n", sx, sy);
-    auto og = output->get_layout_geometry();
-    auto size = output->get_screen_size();
-    auto wsize = output->wset()->get_workspace_grid_size();
-    auto workspaces_horizontal = wsize.width;
-    auto workspaces_vertical = wsize.height;
-
-    int deskstopsY = wsize.height;
-
-    // auto wsize = output->wset()->get_workspace_grid_size();
-    float max = std::max(wsize.width, wsize.height);
-
-    // float grid_start_x = (og.width * (max - wsize.width) / float(max) / 2)+
-    // (size.width/2) - 180; workspace_rect.width/numberofdesktopinYdirection/2
-    float grid_start_x = (og.width * (max - wsize.width) / float(max) / 2) +
-                         size.width / 2 - (size.width / deskstopsY / 2);
-    float grid_start_y = og.height * (max - wsize.height) / float(max) / 2;
+    auto global = get_input_transform().to_global({sx, sy});
+    sx = global.x;
+    sy = global.y;
+  }
 
-    sx -= grid_start_x;
-    sy -= grid_start_y;
+  dock_input_transform_t input_transform;
 
-    sx *= max;
-    sy *= max;
+  const dock_input_transform_t& get_input_transform() {
+    if (!input_transform.is_valid()) {
+      input_transform.rebuild(output);
+    }
 
-    //  printf("grid %d", windows);
+    return input_transform;
   }
 
+  wf::signal::connection_t<wf::output_configuration_changed_signal>
+      on_output_config_changed = [=](wf::output_configuration_changed_signal* ev) {
+        if (ev->changed_fields & (wf::OUTPUT_MODE_CHANGE |
+                                  wf::OUTPUT_SCALE_CHANGE |
+                                  wf::OUTPUT_TRANSFORM_CHANGE)) {
+          input_transform.invalidate();
+        }
+      };
+
   /**
    * Find the coordinate of the given point from output-local coordinates
    * to output-workspace-local coordinates
@@ -1025,34 +1191,16 @@ class wayfire_expo : public wf::per_output_plugin_instance_t,
   }
 
   wayfire_toplevel_view find_view_at_coordinates(int gx, int gy) {
-    printf("find_view_at_coordinates(\n");
-    auto local = input_coordinates_to_output_local_coordinates({gx, gy});
-    wf::pointf_t localf = {1.0 * local.x, 1.0 * local.y};
-
-    // Print the local coordinates
-    //    std::cout << "Local Coordinates: x = " << localf.x << ", y = " <<
-    //    localf.y << std::endl;
-    printf("localf.x = %f,localf.y =%f/n", localf.x, localf.y);
+    auto global = get_input_transform().to_global({gx, gy});
+    DOCK_TRACE(TRACE, INPUT, "hit test at %d,%d -> %d,%d", gx, gy, global.x,
+               global.y);
 
-    return wf::find_output_view_at(output, localf);
+    return view_index->find_view_at(global);
   }
 
   void update_target_workspace(int x, int y) {
-    printf("update_target_workspace(\n");
-    auto og = output->get_layout_geometry();
-
     input_coordinates_to_global_coordinates(x, y);
-
-    auto size = output->get_screen_size();
-    auto wsize = output->wset()->get_workspace_grid_size();
-    auto workspaces_horizontal = wsize.width;
-    auto workspaces_vertical = wsize.height;
-    int deskstopsY = wsize.height;
-    float max = std::max(wsize.width, wsize.height);
-    float grid_start_x = (og.width * (max - wsize.width) / float(max) / 2) +
-                         size.width / 2 - (size.width / deskstopsY / 2);
-
-  //  wf::pointf_t cursor_position = wf::get_core().get_cursor_position();
+    const auto& transform = get_input_transform();
 
     if (x >= 0) {
       main_workspace = false;
@@ -1060,27 +1208,22 @@ class wayfire_expo : public wf::per_output_plugin_instance_t,
       drag_helper->set_scale(std::max(vw, vh));
       input_grab->set_wants_raw_input(true);
 
-      auto grid = get_grid_geometry();
-      if (!(grid & wf::point_t{x, y})) {
+      if (!(transform.get_grid() & wf::point_t{x, y})) {
         return;
       }
 
-      int tmpx = x / og.width;
-      int tmpy = y / og.height;
-      if ((tmpx != target_ws.x) || (tmpy != target_ws.y)) {
+      auto ws = transform.workspace_at({x, y});
+      if (ws != target_ws) {
         shade_workspace(target_ws, true);
 
-        target_ws = {tmpx, tmpy};
+        target_ws = ws;
         shade_workspace(target_ws, false);
       }
 
     } else if (x < 0) {
-      printf("x is less than zero/n");
+      DOCK_TRACE(TRACE, INPUT, "target is the main desktop");
 
       main_workspace = true;
-      int tmpx = x / og.width;
-      int tmpy = y / og.height;
-      //  if ((tmpx != target_ws.x) || (tmpy != target_ws.y))
       {
         //     target_ws = initial_ws;
         shade_workspace(target_ws, true);
@@ -1090,21 +1233,47 @@ class wayfire_expo : public wf::per_output_plugin_instance_t,
       }
 
       auto [vw, vh] = output->wset()->get_workspace_grid_size();
-      drag_helper->set_scale(std::max(vw / deskstopsY, vh / deskstopsY));
+      drag_helper->set_scale(std::max(vw / vh, 1));
       input_grab->set_wants_raw_input(true);
       //       input_grab->ungrab_input();
 
       // drag_helper->handle_input_released();
     }
   }
-  wf::effect_hook_t pre_frame = [=]() {
-    output->render->damage_whole();
-    // Get the cursor position
-    wf::pointf_t cursor_position = wf::get_core().get_cursor_position();
+  // The dock is damage-driven: workspace streams, workspace fades and
+  // zoom_animation damage only what they change, so a static desktop renders
+  // no frames. The hot-zone therefore follows the pointer motion, which is
+  // seen here whether or not the dock grabs input.
+  wf::signal::connection_t<
+      wf::post_input_event_signal<wlr_pointer_motion_event>>
+      on_pointer_motion = [=](auto) {
+        update_hot_zone();
+      };
+
+  wf::signal::connection_t<
+      wf::post_input_event_signal<wlr_pointer_motion_absolute_event>>
+      on_pointer_motion_absolute = [=](auto) {
+        update_hot_zone();
+      };
+
+  wf::dock_timing::timer_stats_t pre_frame_timing;
+
+  // Wall-clock time between the pre-frame and the post-frame effect hooks of
+  // a frame. GL work which the driver runs asynchronously is not included.
+  wf::dock_timing::timer_stats_t frame_wall_timing;
+  std::optional<std::chrono::steady_clock::time_point> frame_start;
 
-    // Call the printCursorPos function
-    CursorPos(cursor_position);
+  wf::effect_hook_t post_frame = [=]() {
+    if (frame_start) {
+      frame_wall_timing.add(std::chrono::steady_clock::now() - *frame_start);
+      frame_start.reset();
+    }
+  };
 
+  wf::effect_hook_t pre_frame = [=]() {
+    frame_start = std::chrono::steady_clock::now();
+    wf::dock_timing::scoped_timer_t timer{pre_frame_timing};
+    flush_pending_motion();
     if (zoom_animation.running()) {
       wall->set_viewport(zoom_animation);
     } else if (!state.zoom_in) {
@@ -1113,36 +1282,24 @@ class wayfire_expo : public wf::per_output_plugin_instance_t,
       return;
     }
 
-    auto size = this->output->wset()->get_workspace_grid_size();
-    for (int x = 0; x < size.width; x++) {
-      for (int y = 0; y < size.height; y++) {
-        auto& anim = ws_fade.at(x).at(y);
-        if (anim.running()) {
-          wall->set_ws_dim({x, y}, anim);
-        }
+    auto& ws_state = wall->get_workspace_state();
+    for (int i = 0; i < ws_state.size(); i++) {
+      auto& anim = ws_state.fade[i];
+      if (anim.running()) {
+        wall->set_ws_dim(ws_state.workspace(i), anim);
       }
     }
   };
 
   void resize_ws_fade() {
-    printf("resize_ws_fade\n");
-    auto size = this->output->wset()->get_workspace_grid_size();
-    ws_fade.resize(size.width);
-    for (auto& v : ws_fade) {
-      size_t h = size.height;
-      if (v.size() > h) {
-        v.resize(h);
-      } else {
-        while (v.size() < h) {
-          v.emplace_back(transition_length);
-        }
-      }
-    }
+    wall->get_workspace_state().resize(
+        output->wset()->get_workspace_grid_size(), transition_length);
   }
 
   wf::signal::connection_t<wf::workspace_grid_changed_signal>
       on_workspace_grid_changed = [=](auto) {
         resize_ws_fade();
+        input_transform.invalidate();
 
         // check that the target and initial workspaces are still in the grid
         auto size = this->output->wset()->get_workspace_grid_size();
@@ -1157,7 +1314,7 @@ class wayfire_expo : public wf::per_output_plugin_instance_t,
       };
 
   void finalize_and_exit() {
-    printf("finalize_and_exit\n");
+    DOCK_TRACE(DEBUG, RENDER, "finalize and exit");
     state.active = false;
     if (drag_helper->view) {
       drag_helper->handle_input_released();
@@ -1168,6 +1325,14 @@ class wayfire_expo : public wf::per_output_plugin_instance_t,
     input_grab->ungrab_input();
     wall->stop_output_renderer(true);  //
     output->render->rem_effect(&pre_frame);
+    output->render->rem_effect(&post_frame);
+    frame_start.reset();
+    on_pointer_motion.disconnect();
+    on_pointer_motion_absolute.disconnect();
+    view_index->disconnect();
+    pending_motion.reset();
+    hot_zone_dwell_timer.disconnect();
+    hot_zone = hot_zone_t::DESKTOP;
     key_repeat.disconnect();
     key_pressed = 0;
 
@@ -1180,8 +1345,59 @@ class wayfire_expo : public wf::per_output_plugin_instance_t,
         highlight_active_workspace();
   }
 
+  /**
+   * Get the timing of the dock on this output, see the expo/stats IPC method.
+   */
+  nlohmann::json get_timing_stats() {
+    auto& timing = wall->get_timing();
+    nlohmann::json stats;
+    stats["pre_frame"] = timer_to_json(pre_frame_timing);
+    stats["frame_wall"] = timer_to_json(frame_wall_timing);
+    stats["schedule_instructions"] = timer_to_json(timing.schedule_instructions);
+    stats["render"]["background"] = timer_to_json(timing.background);
+    stats["render"]["frame_event"] = timer_to_json(timing.frame_event);
+    stats["render"]["thumbnail"] = timer_to_json(timing.thumbnail);
+
+    auto& damage = wall->get_damage_counters();
+    stats["damage"]["calls"] = damage.calls;
+    stats["damage"]["rects_in"] = damage.rects_in;
+    stats["damage"]["rects_out"] = damage.rects_out;
+
+    auto& ws_state = wall->get_workspace_state();
+    stats["workspaces"] = nlohmann::json::array();
+    for (int i = 0; i < ws_state.size(); i++) {
+      auto ws = ws_state.workspace(i);
+      auto entry = timer_to_json(ws_state.thumbnail_time[i]);
+      entry["x"] = ws.x;
+      entry["y"] = ws.y;
+      stats["workspaces"].push_back(entry);
+    }
+
+    return stats;
+  }
+
+  void reset_timing_stats() {
+    pre_frame_timing.reset();
+    frame_wall_timing.reset();
+    wall->get_timing() = {};
+    wall->get_damage_counters() = {};
+    for (auto& stats : wall->get_workspace_state().thumbnail_time) {
+      stats.reset();
+    }
+  }
+
+  static nlohmann::json timer_to_json(
+      const wf::dock_timing::timer_stats_t& stats) {
+    auto summary = stats.summarize();
+    return {
+        {"count", summary.count},   {"min_us", summary.min_us},
+        {"avg_us", summary.avg_us}, {"p99_us", summary.p99_us},
+        {"max_us", summary.max_us},
+    };
+  }
+
   void fini() override {
-    printf("fini\n");
+    DOCK_TRACE(INFO, RENDER, "fini on %s", output->to_string().c_str());
     if (state.active) {
       finalize_and_exit();
     }
@@ -1192,14 +1408,98 @@ class wayfire_expo_global
     : public wf::plugin_interface_t,
       public wf::per_output_tracker_mixin_t<wayfire_expo> {
   wf::ipc_activator_t toggle_binding{"expo/toggle"};
+  wf::shared_data::ref_ptr_t<wf::ipc::method_repository_t> ipc_repo;
+  wf::shared_data::ref_ptr_t<wf::move_drag::core_drag_t> drag_helper;
+
+  // CPU time of the drag helper's pre-frame hook, see
+  // core_drag_t::pre_frame_profiler.
+  wf::dock_timing::timer_stats_t drag_pre_frame_timing;
 
  public:
   void init() override {
     this->init_output_tracking();
+    drag_helper->pre_frame_profiler = [=](auto duration) {
+      drag_pre_frame_timing.add(duration);
+    };
     toggle_binding.set_handler(toggle_cb);
+    ipc_repo->register_method("expo/trace-dump", trace_dump);
+    ipc_repo->register_method("expo/trace-filter", trace_filter);
+    ipc_repo->register_method("expo/stats", stats);
+    ipc_repo->register_method("expo/stats-reset", stats_reset);
+  }
+
+  void fini() override {
+    ipc_repo->unregister_method("expo/trace-dump");
+    ipc_repo->unregister_method("expo/trace-filter");
+    ipc_repo->unregister_method("expo/stats");
+    ipc_repo->unregister_method("expo/stats-reset");
+    drag_helper->pre_frame_profiler = nullptr;
+    this->fini_output_tracking();
   }
 
-  void fini() override { this->fini_output_tracking(); }
+  /**
+   * Return min/avg/p99/max CPU time of the dock's per-frame work on each
+   * output, including a per-workspace breakdown of thumbnail rendering, and
+   * of the drag helper.
+   */
+  wf::ipc::method_callback stats = [=](nlohmann::json) {
+    auto response = wf::ipc::json_ok();
+    response["outputs"] = nlohmann::json::object();
+    for (auto& [output, instance] : output_instance) {
+      response["outputs"][output->to_string()] = instance->get_timing_stats();
+    }
+
+    response["drag_pre_frame"] =
+        wayfire_expo::timer_to_json(drag_pre_frame_timing);
+    return response;
+  };
+
+  wf::ipc::method_callback stats_reset = [=](nlohmann::json) {
+    for (auto& [output, instance] : output_instance) {
+      instance->reset_timing_stats();
+    }
+
+    drag_pre_frame_timing.reset();
+    return wf::ipc::json_ok();
+  };
+
+  /**
+   * Return the messages in the dock trace buffer, oldest first.
+   */
+  wf::ipc::method_callback trace_dump = [=](nlohmann::json) {
+    auto response = wf::ipc::json_ok();
+    response["lines"] = wf::dock_trace::get_buffer().dump();
+    return response;
+  };
+
+  /**
+   * Set which trace messages are recorded.
+   *
+   * Arguments: "level" (1 = error ... 4 = trace) and "categories", a list of
+   * "input", "render" and "drag".
+   */
+  wf::ipc::method_callback trace_filter = [=](nlohmann::json data) {
+    if (!data.contains("level") || !data["level"].is_number_integer() ||
+        !data.contains("categories") || !data["categories"].is_array()) {
+      return wf::ipc::json_error("expected level and categories");
+    }
+
+    uint32_t categories = 0;
+    for (auto& name : data["categories"]) {
+      if (name == "input") {
+        categories |= wf::dock_trace::INPUT;
+      } else if (name == "render") {
+        categories |= wf::dock_trace::RENDER;
+      } else if (name == "drag") {
+        categories |= wf::dock_trace::DRAG;
+      } else {
+        return wf::ipc::json_error("unknown category");
+      }
+    }
+
+    wf::dock_trace::get_buffer().set_filter(data["level"], categories);
+    return wf::ipc::json_ok();
+  };
 
   wf::ipc_activator_t::handler_t toggle_cb = [=](wf::output_t* output,
                                                  wayfire_view) {